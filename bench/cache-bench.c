@@ -0,0 +1,387 @@
+/*
+ * cache-bench.c - microbenchmarks for the proxy's web object cache
+ *
+ * Two parts, both linked against the real pcache.c:
+ *
+ * ops    ns per call of in_cache (hit and miss), add_line (with the
+ *        evictions it triggers), choose_evict and age_lines, single
+ *        threaded, for caches holding few large or many small objects.
+ *        All of them walk the whole list, so their cost grows with the
+ *        number of lines, not with the bytes cached.
+ *
+ * mix    T threads issue lookups the way the proxy does: in_cache and a
+ *        copy of the object under the read lock; on a miss, make_line
+ *        outside the lock and in_cache + add_line under the write lock.
+ *        Keys are Zipfian or uniform over K objects whose sizes are
+ *        fixed or spread log-uniformly up to MAX_OBJECT_SIZE. Reports
+ *        ops/s, hit ratio, and the time spent waiting for the lock
+ *        (share of all thread time, and p50/p99 of a single wait).
+ *
+ * usage: cache-bench [-p ops|mix|all] [-t threads,...] [-d zipf,uniform]
+ *                    [-s sizes,...] [-k keys] [-a zipf exponent]
+ *                    [-n ops per run]
+ *
+ * A size is a byte count or "mixed" (256 B .. MAX_OBJECT_SIZE).
+ */
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "csapp.h"
+#include "pcache.h"
+#include "hist.h"
+
+#define HOST "bench.local:80"
+#define MAX_THREADS 64
+#define MAX_LIST 16
+
+static cache web_cache;
+static pthread_rwlock_t cache_lock;
+
+static char **paths;               /* paths[k]: path of key k */
+static unsigned *sizes;            /* sizes[k]: object size of key k */
+static double *zipf_cdf;           /* Cumulative probability of keys 0..k */
+static int num_keys = 10000;
+static double zipf_s = 0.99;
+static long ops = 200000;
+static char object[MAX_OBJECT_SIZE];
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+/* Uniform double in [0, 1) */
+static double uniform01(uint64_t *s)
+{
+  return (xorshift(s) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static void make_keys(void)
+{
+  double sum = 0;
+  int k;
+
+  paths = malloc(num_keys * sizeof(char *));
+  sizes = malloc(num_keys * sizeof(unsigned));
+  zipf_cdf = malloc(num_keys * sizeof(double));
+  for (k = 0; k < num_keys; k++) {
+    char path[64];
+
+    sprintf(path, "/objects/%d.bin", k);
+    paths[k] = strdup(path);
+    sum += 1.0 / pow(k + 1, zipf_s);
+    zipf_cdf[k] = sum;
+  }
+  for (k = 0; k < num_keys; k++)
+    zipf_cdf[k] /= sum;
+}
+
+/*
+ * set_sizes - object sizes for every key: [size] bytes, or log-uniform
+ *             between 256 and MAX_OBJECT_SIZE if size is 0 ("mixed")
+ */
+static void set_sizes(unsigned size)
+{
+  uint64_t seed = 0x2545f4914f6cdd1dULL;
+  int k;
+
+  for (k = 0; k < num_keys; k++)
+    sizes[k] = size ? size : (unsigned)(256 * pow(MAX_OBJECT_SIZE / 256.0, uniform01(&seed)));
+}
+
+static int draw_key(int zipf, uint64_t *seed)
+{
+  double u;
+  int lo = 0, hi = num_keys - 1, mid;
+
+  if (!zipf)
+    return (int)(xorshift(seed) % num_keys);
+  u = uniform01(seed);
+  while (lo < hi) {                /* First key whose CDF reaches u */
+    mid = (lo + hi) / 2;
+    if (zipf_cdf[mid] < u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void empty_cache(void)
+{
+  while (web_cache.start)
+    remove_line(&web_cache, web_cache.start);
+}
+
+/* Fill the cache with keys 0, 1, ... until it is full; returns the line count */
+static int fill_cache(void)
+{
+  int k, n = 0;
+
+  empty_cache();
+  for (k = 0; k < num_keys && !cache_full(&web_cache); k++, n++)
+    add_line(&web_cache, make_line(HOST, paths[k], object, sizes[k]));
+  return n;
+}
+
+
+/*****
+ * ops
+ *****/
+
+static void run_ops(unsigned size, const char *size_name)
+{
+  double t0, ns_hit, ns_miss, ns_add, ns_evict, ns_age;
+  uint64_t seed = 1;
+  long i, reps;
+  int lines, next;
+  line *lion;
+
+  set_sizes(size);
+  lines = fill_cache();
+  reps = ops / (lines + 1) + 1000;
+
+  t0 = now_ns();
+  for (i = 0; i < reps; i++)
+    if (!in_cache(&web_cache, HOST, paths[xorshift(&seed) % lines]))
+      abort();
+  ns_hit = (now_ns() - t0) / reps;
+
+  t0 = now_ns();
+  for (i = 0; i < reps; i++)
+    in_cache(&web_cache, HOST, "/not/cached");
+  ns_miss = (now_ns() - t0) / reps;
+
+  t0 = now_ns();
+  for (i = 0; i < reps; i++)
+    choose_evict(&web_cache);
+  ns_evict = (now_ns() - t0) / reps;
+
+  t0 = now_ns();
+  for (i = 0; i < reps; i++)
+    age_lines(&web_cache);
+  ns_age = (now_ns() - t0) / reps;
+
+  /* add_line on a full cache: each add evicts (and frees) what it must */
+  next = lines;
+  t0 = now_ns();
+  for (i = 0; i < reps; i++) {
+    lion = make_line(HOST, paths[next], object, sizes[next]);
+    add_line(&web_cache, lion);
+    next = (next + 1) % num_keys;
+  }
+  ns_add = (now_ns() - t0) / reps;
+
+  printf("%-10s %6d %12.0f %12.0f %12.0f %12.0f %12.0f\n", size_name, lines,
+         ns_hit, ns_miss, ns_add, ns_evict, ns_age);
+}
+
+
+/*****
+ * mix
+ *****/
+
+typedef struct {
+  pthread_t tid;
+  int id, zipf;
+  long ops;
+  uint64_t hits, misses;
+  double busy_ns;                  /* Wall time of this thread's run */
+  hist_t wait;                     /* ns waiting for the lock */
+} worker_t;
+
+static void *mix_thread(void *vargp)
+{
+  worker_t *w = vargp;
+  uint64_t seed = 0x9e3779b97f4a7c15ULL * (w->id + 1);
+  char *copy = malloc(MAX_OBJECT_SIZE);
+  double t0, t;
+  line *lion;
+  long i;
+  int k;
+
+  t0 = now_ns();
+  for (i = 0; i < w->ops; i++) {
+    k = draw_key(w->zipf, &seed);
+
+    t = now_ns();
+    Pthread_rwlock_rdlock(&cache_lock);
+    hist_record(&w->wait, (uint64_t)(now_ns() - t));
+    if ((lion = in_cache(&web_cache, HOST, paths[k]))) {
+      memcpy(copy, lion->obj, lion->size);   /* As serve_from_cache does */
+      Pthread_rwlock_unlock(&cache_lock);
+      w->hits++;
+      continue;
+    }
+    Pthread_rwlock_unlock(&cache_lock);
+    w->misses++;
+
+    lion = make_line(HOST, paths[k], object, sizes[k]);
+    t = now_ns();
+    Pthread_rwlock_wrlock(&cache_lock);
+    hist_record(&w->wait, (uint64_t)(now_ns() - t));
+    if (in_cache(&web_cache, HOST, paths[k])) {
+      Pthread_rwlock_unlock(&cache_lock);
+      Free(lion->loc);
+      Free(lion->obj);
+      Free(lion);
+      continue;
+    }
+    add_line(&web_cache, lion);
+    Pthread_rwlock_unlock(&cache_lock);
+  }
+  w->busy_ns = now_ns() - t0;
+  free(copy);
+  return NULL;
+}
+
+static void run_mix(int zipf, unsigned size, const char *size_name, int nthreads)
+{
+  static worker_t workers[MAX_THREADS];
+  uint64_t hits = 0, misses = 0;
+  double t0, secs, busy = 0, waited;
+  hist_t wait;
+  int i;
+
+  set_sizes(size);
+  empty_cache();
+  hist_init(&wait);
+  for (i = 0; i < nthreads; i++) {
+    memset(&workers[i], 0, sizeof(worker_t));
+    workers[i].id = i;
+    workers[i].zipf = zipf;
+    workers[i].ops = ops / nthreads;
+    hist_init(&workers[i].wait);
+  }
+  t0 = now_ns();
+  for (i = 0; i < nthreads; i++)
+    Pthread_create(&workers[i].tid, NULL, mix_thread, &workers[i]);
+  for (i = 0; i < nthreads; i++) {
+    Pthread_join(workers[i].tid, NULL);
+    hits += workers[i].hits;
+    misses += workers[i].misses;
+    busy += workers[i].busy_ns;
+    hist_merge(&wait, &workers[i].wait);
+  }
+  secs = (now_ns() - t0) / 1e9;
+  waited = wait.sum;
+
+  printf("%-8s %-8s %4d %12.0f %7.1f%% %8.1f%% %10.0f %10.0f\n",
+         zipf ? "zipf" : "uniform", size_name, nthreads, (hits + misses) / secs,
+         100.0 * hits / (hits + misses), busy > 0 ? 100.0 * waited / busy : 0,
+         (double)hist_percentile(&wait, 50), (double)hist_percentile(&wait, 99));
+}
+
+
+/***********
+ * Options
+ ***********/
+
+/* split - parse comma-separated [arg] into at most MAX_LIST strings */
+static int split(char *arg, char **items)
+{
+  int n = 0;
+  char *tok;
+
+  for (tok = strtok(arg, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+    items[n++] = tok;
+  return n;
+}
+
+static unsigned parse_size(const char *s)
+{
+  long n;
+
+  if (!strcmp(s, "mixed"))
+    return 0;
+  n = atol(s);
+  if (n <= 0 || n > MAX_OBJECT_SIZE) {
+    fprintf(stderr, "size must be 1..%d or \"mixed\": %s\n", MAX_OBJECT_SIZE, s);
+    exit(1);
+  }
+  return (unsigned)n;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-p ops|mix|all] [-t threads,...] [-d zipf,uniform] [-s sizes,...]\n"
+          "       [-k keys] [-a zipf exponent] [-n ops per run]\n"
+          "  -p  which part to run (default all)\n"
+          "  -t  thread counts for mix, up to %d (default 1,2,4,8,16,32,64)\n"
+          "  -d  key distributions for mix (default zipf,uniform)\n"
+          "  -s  object sizes in bytes, or mixed (default 1024,mixed,65536)\n"
+          "  -k  distinct keys (default 10000)\n"
+          "  -a  Zipf exponent (default 0.99)\n"
+          "  -n  operations per run (default 200000)\n", prog, MAX_THREADS);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char threads_arg[256] = "1,2,4,8,16,32,64", dists_arg[256] = "zipf,uniform";
+  char sizes_arg[256] = "1024,mixed,65536", *part = "all";
+  char *threads[MAX_LIST], *dists[MAX_LIST], *size_names[MAX_LIST];
+  int nthreads, ndists, nsizes, c, d, s, t, n;
+
+  while ((c = getopt(argc, argv, "p:t:d:s:k:a:n:")) != -1) {
+    switch (c) {
+    case 'p': part = optarg; break;
+    case 't': snprintf(threads_arg, sizeof(threads_arg), "%s", optarg); break;
+    case 'd': snprintf(dists_arg, sizeof(dists_arg), "%s", optarg); break;
+    case 's': snprintf(sizes_arg, sizeof(sizes_arg), "%s", optarg); break;
+    case 'k': num_keys = atoi(optarg); break;
+    case 'a': zipf_s = atof(optarg); break;
+    case 'n': ops = atol(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (num_keys <= 0 || ops <= 0)
+    usage(argv[0]);
+  nthreads = split(threads_arg, threads);
+  ndists = split(dists_arg, dists);
+  nsizes = split(sizes_arg, size_names);
+  for (s = 0; s < nsizes; s++)
+    parse_size(size_names[s]);
+
+  memset(object, 'x', sizeof(object));
+  make_keys();
+  cache_init(&web_cache, &cache_lock);
+
+  if (!strcmp(part, "ops") || !strcmp(part, "all")) {
+    printf("pcache operations, ns per call (1 thread)\n");
+    printf("%-10s %6s %12s %12s %12s %12s %12s\n", "size", "lines", "in_cache hit",
+           "in_cache miss", "add_line", "choose_evict", "age_lines");
+    for (s = 0; s < nsizes; s++)
+      run_ops(parse_size(size_names[s]), size_names[s]);
+    printf("\n");
+  }
+  if (!strcmp(part, "mix") || !strcmp(part, "all")) {
+    printf("proxy-style lookups + inserts, %d keys, %ld ops per run\n", num_keys, ops);
+    printf("%-8s %-8s %4s %12s %8s %9s %10s %10s\n", "keys", "size", "thr", "ops/s",
+           "hits", "lockwait", "wait p50ns", "wait p99ns");
+    for (d = 0; d < ndists; d++)
+      for (s = 0; s < nsizes; s++)
+        for (t = 0; t < nthreads; t++) {
+          n = atoi(threads[t]);
+          if (n < 1 || n > MAX_THREADS)
+            usage(argv[0]);
+          run_mix(!strcmp(dists[d], "zipf"), parse_size(size_names[s]), size_names[s], n);
+        }
+  }
+  return 0;
+}
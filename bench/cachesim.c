@@ -0,0 +1,306 @@
+/*
+ * cachesim.c - offline cache simulator for request traces
+ *
+ * Replays a trace (see trace.h) against cache policies with no
+ * networking, and reports the hit ratio and byte-hit ratio of each.
+ * Every request is a lookup; a miss inserts the object if it is no
+ * bigger than MAX_OBJECT_SIZE, as the proxy does.
+ *
+ * pcache   the proxy's own pcache.c, unmodified: its aging LRU, and
+ *          its rule that the cache is full once less than
+ *          MAX_OBJECT_SIZE is free. It always has MAX_CACHE_SIZE.
+ * lru      exact LRU
+ * fifo     evict in insertion order; hits change nothing
+ * lfu      evict the least often hit (ties: least recently used)
+ *
+ * The simulated policies evict only as much as the new object needs,
+ * at each capacity given with -C.
+ *
+ * usage: cachesim [-p pcache,lru,fifo,lfu] [-C bytes,...] trace.jsonl
+ *        (sizes take a K or M suffix)
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csapp.h"
+#include "pcache.h"
+#include "trace.h"
+
+#define MAX_LIST 16
+#define HASH_BITS 16
+
+enum { LRU, FIFO, LFU };
+
+/* An object in a simulated cache */
+typedef struct entry {
+  char *key;
+  long size;
+  uint64_t hits;
+  struct entry *prev, *next;       /* Recency (or insertion) list, newest first */
+  struct entry *hnext;             /* Hash chain */
+} entry_t;
+
+typedef struct {
+  int policy;
+  long capacity, used;
+  entry_t *head, *tail;
+  entry_t *table[1 << HASH_BITS];
+} sim_t;
+
+typedef struct {
+  uint64_t requests, hits, bytes, hit_bytes, uncacheable;
+} result_t;
+
+static trace_rec_t *trace;
+static long trace_len;
+static char object[MAX_OBJECT_SIZE];
+
+static unsigned hash(const char *s)
+{
+  unsigned long h = 5381;
+
+  while (*s)
+    h = h * 33 + (unsigned char)*s++;
+  return (unsigned)(h ^ (h >> HASH_BITS)) & ((1 << HASH_BITS) - 1);
+}
+
+static void unlink_entry(sim_t *c, entry_t *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    c->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    c->tail = e->prev;
+}
+
+static void push_front(sim_t *c, entry_t *e)
+{
+  e->prev = NULL;
+  e->next = c->head;
+  if (c->head)
+    c->head->prev = e;
+  else
+    c->tail = e;
+  c->head = e;
+}
+
+static void evict(sim_t *c)
+{
+  entry_t *victim = c->tail, *e, **pp;
+
+  if (c->policy == LFU)               /* Oldest among the least hit */
+    for (e = c->tail; e; e = e->prev)
+      if (e->hits < victim->hits)
+        victim = e;
+  unlink_entry(c, victim);
+  for (pp = &c->table[hash(victim->key)]; *pp != victim; pp = &(*pp)->hnext)
+    ;
+  *pp = victim->hnext;
+  c->used -= victim->size;
+  free(victim->key);
+  free(victim);
+}
+
+/* sim_access - look [key] up, inserting it on a miss; returns 1 on a hit */
+static int sim_access(sim_t *c, char *key, long size)
+{
+  unsigned h = hash(key);
+  entry_t *e;
+
+  for (e = c->table[h]; e; e = e->hnext)
+    if (!strcmp(e->key, key)) {
+      e->hits++;
+      if (c->policy != FIFO) {
+        unlink_entry(c, e);
+        push_front(c, e);
+      }
+      return 1;
+    }
+  if (size < 0 || size > MAX_OBJECT_SIZE || size > c->capacity)
+    return 0;
+  while (c->used + size > c->capacity)
+    evict(c);
+  e = malloc(sizeof(entry_t));
+  e->key = strdup(key);
+  e->size = size;
+  e->hits = 0;
+  e->hnext = c->table[h];
+  c->table[h] = e;
+  push_front(c, e);
+  c->used += size;
+  return 0;
+}
+
+static void sim_free(sim_t *c)
+{
+  while (c->head)
+    evict(c);
+  free(c);
+}
+
+static void count(result_t *res, long size, int hit)
+{
+  res->requests++;
+  if (size > 0)
+    res->bytes += size;
+  if (hit) {
+    res->hits++;
+    if (size > 0)
+      res->hit_bytes += size;
+  }
+  else if (size < 0 || size > MAX_OBJECT_SIZE)
+    res->uncacheable++;
+}
+
+static void run_sim(int policy, long capacity, result_t *res)
+{
+  sim_t *c = calloc(1, sizeof(sim_t));
+  long r;
+
+  c->policy = policy;
+  c->capacity = capacity;
+  for (r = 0; r < trace_len; r++)
+    count(res, trace[r].size, sim_access(c, trace[r].url, trace[r].size));
+  sim_free(c);
+}
+
+/*
+ * split_url - host:port and path of [url] as pcache keys them
+ *             (the whole string as the path if it isn't http://)
+ */
+static void split_url(char *url, char *hostport, size_t hsize, char **pathp)
+{
+  char *slash;
+
+  if (strncasecmp(url, "http://", 7)) {
+    snprintf(hostport, hsize, "%s", "");
+    *pathp = url;
+    return;
+  }
+  url += 7;
+  if (!(slash = strchr(url, '/')))
+    slash = url + strlen(url);
+  snprintf(hostport, hsize, "%.*s%s", (int)(slash - url), url,
+           memchr(url, ':', slash - url) ? "" : ":80");
+  *pathp = *slash ? slash : "/";
+}
+
+static void run_pcache(result_t *res)
+{
+  static cache web_cache;
+  static pthread_rwlock_t lock;
+  char hostport[1024], *path;
+  long r, size;
+  int hit;
+
+  cache_init(&web_cache, &lock);
+  for (r = 0; r < trace_len; r++) {
+    split_url(trace[r].url, hostport, sizeof(hostport), &path);
+    size = trace[r].size;
+    hit = in_cache(&web_cache, hostport, path) != NULL;
+    if (!hit && size >= 0 && size <= MAX_OBJECT_SIZE)
+      add_line(&web_cache, make_line(hostport, path, object, size));
+    count(res, size, hit);
+  }
+  while (web_cache.start)
+    remove_line(&web_cache, web_cache.start);
+}
+
+static void print_result(const char *policy, long capacity, const result_t *res)
+{
+  printf("%-8s %10ld %10llu %8.2f%% %8.2f%% %12llu\n", policy, capacity,
+         (unsigned long long)res->requests,
+         res->requests ? 100.0 * res->hits / res->requests : 0,
+         res->bytes ? 100.0 * res->hit_bytes / res->bytes : 0,
+         (unsigned long long)res->uncacheable);
+}
+
+static long parse_bytes(const char *s)
+{
+  char *end;
+  double v = strtod(s, &end);
+
+  if (*end == 'K' || *end == 'k')
+    v *= 1024;
+  else if (*end == 'M' || *end == 'm')
+    v *= 1024 * 1024;
+  return (long)v;
+}
+
+static int split(char *arg, char **items)
+{
+  int n = 0;
+  char *tok;
+
+  for (tok = strtok(arg, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+    items[n++] = tok;
+  return n;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-p pcache,lru,fifo,lfu] [-C bytes,...] trace.jsonl\n"
+          "  -p  policies to simulate (default all)\n"
+          "  -C  capacities for lru/fifo/lfu, with K or M suffixes (default %d)\n",
+          prog, MAX_CACHE_SIZE);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char policies_arg[256] = "pcache,lru,fifo,lfu", caps_arg[256] = "";
+  char *policies[MAX_LIST], *caps[MAX_LIST];
+  int npolicies, ncaps, c, p, k;
+  result_t res;
+  long capacity;
+
+  while ((c = getopt(argc, argv, "p:C:")) != -1) {
+    switch (c) {
+    case 'p': snprintf(policies_arg, sizeof(policies_arg), "%s", optarg); break;
+    case 'C': snprintf(caps_arg, sizeof(caps_arg), "%s", optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+  if (!caps_arg[0])
+    sprintf(caps_arg, "%d", MAX_CACHE_SIZE);
+  npolicies = split(policies_arg, policies);
+  ncaps = split(caps_arg, caps);
+  if ((trace_len = trace_load(argv[optind], &trace)) < 0)
+    exit(1);
+  memset(object, 'x', sizeof(object));
+
+  printf("%ld requests; objects over %d bytes are never cached\n", trace_len, MAX_OBJECT_SIZE);
+  printf("%-8s %10s %10s %9s %9s %12s\n", "policy", "capacity", "requests", "hits",
+         "byte hits", "uncacheable");
+  for (p = 0; p < npolicies; p++) {
+    if (!strcmp(policies[p], "pcache")) {
+      memset(&res, 0, sizeof(res));
+      run_pcache(&res);
+      print_result("pcache", MAX_CACHE_SIZE, &res);
+      continue;
+    }
+    for (k = 0; k < ncaps; k++) {
+      if ((capacity = parse_bytes(caps[k])) <= 0)
+        usage(argv[0]);
+      memset(&res, 0, sizeof(res));
+      if (!strcmp(policies[p], "lru"))
+        run_sim(LRU, capacity, &res);
+      else if (!strcmp(policies[p], "fifo"))
+        run_sim(FIFO, capacity, &res);
+      else if (!strcmp(policies[p], "lfu"))
+        run_sim(LFU, capacity, &res);
+      else
+        usage(argv[0]);
+      print_result(policies[p], capacity, &res);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * hist.c - HdrHistogram-style histogram for latencies and wait times
+ *
+ * Bucket b (b >= 1) holds values in [2^(b+7), 2^(b+8)) in 128 equal
+ * steps of 2^b; bucket 0 holds 0..255 exactly. Index = b*128 + (v >> b),
+ * so neighbouring buckets share no indices and none are wasted.
+ */
+#include <string.h>
+#include "hist.h"
+
+static int hist_index(uint64_t v)
+{
+  int b;
+
+  if (v >> HIST_MAX_BITS)
+    v = (1ULL << HIST_MAX_BITS) - 1;
+  b = 63 - __builtin_clzll(v | ((1 << HIST_SUB_BITS) - 1)) - (HIST_SUB_BITS - 1);
+  return b * HIST_HALF + (int)(v >> b);
+}
+
+/* Largest value that lands in counts[i] */
+static uint64_t hist_value(int i)
+{
+  int b = i / HIST_HALF - 1;
+
+  if (b < 0)
+    b = 0;
+  return (((uint64_t)(i - b * HIST_HALF)) << b) + (1ULL << b) - 1;
+}
+
+void hist_init(hist_t *h)
+{
+  memset(h, 0, sizeof(*h));
+  h->min = UINT64_MAX;
+}
+
+void hist_record(hist_t *h, uint64_t value)
+{
+  h->counts[hist_index(value)]++;
+  h->total++;
+  h->sum += value;
+  if (value < h->min)
+    h->min = value;
+  if (value > h->max)
+    h->max = value;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+  int i;
+
+  for (i = 0; i < HIST_COUNTS; i++)
+    dst->counts[i] += src->counts[i];
+  dst->total += src->total;
+  dst->sum += src->sum;
+  if (src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+/*
+ * hist_percentile - smallest recorded value (to the histogram's
+ *                   precision) that percentile% of values are at or below
+ */
+uint64_t hist_percentile(const hist_t *h, double percentile)
+{
+  uint64_t want, seen = 0, v;
+  int i;
+
+  if (h->total == 0)
+    return 0;
+  want = (uint64_t)(percentile / 100.0 * h->total + 0.5);
+  if (want < 1)
+    want = 1;
+  if (want > h->total)
+    want = h->total;
+  for (i = 0; i < HIST_COUNTS; i++) {
+    seen += h->counts[i];
+    if (seen >= want) {
+      v = hist_value(i);
+      return v > h->max ? h->max : (v < h->min ? h->min : v);
+    }
+  }
+  return h->max;
+}
+
+double hist_mean(const hist_t *h)
+{
+  return h->total ? h->sum / h->total : 0;
+}
+
+/*
+ * hist_print - one line of min, percentiles, max and mean, with values
+ *              divided by scale (e.g. 1000 to print us as ms)
+ */
+void hist_print(FILE *fp, const hist_t *h, double scale, const char *unit)
+{
+  fprintf(fp, "min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f %s (mean %.3f)\n",
+          h->total ? h->min / scale : 0, hist_percentile(h, 50) / scale,
+          hist_percentile(h, 90) / scale, hist_percentile(h, 99) / scale,
+          hist_percentile(h, 99.9) / scale, h->max / scale, unit,
+          hist_mean(h) / scale);
+}
@@ -0,0 +1,35 @@
+/*
+ * hist.h - HdrHistogram-style histogram for latencies and wait times
+ *
+ * Values (any unit; the benchmarks record microseconds or nanoseconds)
+ * fall into log-linear buckets: exact below 256, and within 1% above
+ * that (two significant digits), up to 2^HIST_MAX_BITS - 1. Recording
+ * is a couple of shifts and an increment, so each thread keeps its own
+ * histogram and they are merged at the end.
+ */
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 8                   /* 256 sub-buckets per power of 2 */
+#define HIST_HALF (1 << (HIST_SUB_BITS - 1))
+#define HIST_MAX_BITS 40                  /* Larger values are clamped */
+#define HIST_COUNTS ((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_HALF)
+
+typedef struct {
+  uint64_t counts[HIST_COUNTS];
+  uint64_t total;                         /* Values recorded */
+  uint64_t min, max;
+  double sum;
+} hist_t;
+
+void hist_init(hist_t *h);
+void hist_record(hist_t *h, uint64_t value);
+void hist_merge(hist_t *dst, const hist_t *src);
+uint64_t hist_percentile(const hist_t *h, double percentile);
+double hist_mean(const hist_t *h);
+void hist_print(FILE *fp, const hist_t *h, double scale, const char *unit);
+
+#endif
@@ -0,0 +1,685 @@
+/*
+ * loadgen.c - HTTP load generator for tiny and the proxy
+ *
+ * Each of C connections is driven by its own thread, one request at a
+ * time. In the default closed loop a connection sends its next request
+ * as soon as the last response is in, so the server sets the pace and
+ * the result is its throughput. With -r the loop is open: every
+ * connection has a fixed timeline of send times, rate/C per second,
+ * that does not move when the server is slow. Latency is then measured
+ * from the time a request was due, not from when it could finally be
+ * sent: a closed-loop client stalled behind one slow response quietly
+ * skips the requests it would have sent meanwhile ("coordinated
+ * omission"), and its percentiles miss exactly the stall users see.
+ * Service time (from the actual send) is reported next to it; the gap
+ * between the two is time spent queued behind earlier requests.
+ *
+ * URLs come from the command line and/or a file (one per line: a URL,
+ * or a path joined to -b, and optionally a group name; '#' starts a
+ * comment), and each request picks one at random, or in order with -S.
+ * Results are reported for each group as well as overall, e.g. to see
+ * healthy origins' latency while others misbehave. With -x the
+ * requests go to a proxy with absolute URIs; -u makes every URI unique
+ * so that the proxy's cache can't answer them. Latency runs to the last
+ * byte of the response and is reported HdrHistogram-style.
+ *
+ * With -T a captured trace (see trace.h) is replayed instead: every
+ * request is due at its timestamp, divided by -s to replay faster, and
+ * each client's requests go in order over connection client % C. -O
+ * points every URL of the trace at one local origin (origin-sim.py),
+ * keeping the original host in the path and asking for the traced size.
+ *
+ * usage: loadgen [-c conns] [-n requests | -d secs] [-r rate] [-k 0|1]
+ *                [-x proxyhost:port] [-b base] [-f urlfile] [-S] [-u]
+ *                [-T trace [-s speed] [-O host:port]]
+ *                [-t timeout] [-l label] [url...]
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "phttp.h"
+#include "hist.h"
+#include "trace.h"
+
+#define MAXLINE 8192
+#define MAX_ORIGINS 256
+#define RESP_BUF 65536
+#define MAX_GROUPS 16
+
+/* One URL of the mix */
+typedef struct {
+  char *url;
+  char *origin;                    /* host:port, to share lookups */
+  struct addrinfo *addr;           /* Where to connect (origin or proxy) */
+  char *target;                    /* Request-URI: path, or the URL for a proxy */
+  int group;
+} url_t;
+
+/* Results of one group of URLs */
+typedef struct {
+  hist_t lat;                      /* Microseconds from when the request was due */
+  hist_t svc;                      /* Microseconds from when it was sent */
+  uint64_t ok, errors, status[6];  /* status[n]: nxx responses */
+} stats_t;
+
+/* Per-connection results, merged when the run ends */
+typedef struct {
+  pthread_t tid;
+  int id;
+  stats_t *st;                     /* [num_groups] */
+  uint64_t connects, late, bytes;
+  long *recs, num_recs, next_rec;  /* -T: this connection's trace records */
+} conn_t;
+
+static url_t *urls;
+static int num_urls, max_urls;
+static struct {                    /* Lookups done so far, by host:port */
+  char *name;
+  struct addrinfo *addr;
+} origins[MAX_ORIGINS];
+static int num_origins;
+static trace_rec_t *trace;
+static int *trace_urls;            /* trace_urls[r]: index in urls of record r */
+static long trace_len;
+static double speed = 1;
+static char *trace_origin;
+static char *groups[MAX_GROUPS];
+static int num_groups;
+static int conns = 8, keepalive = 1, sequential, unique, timeout_s = 10;
+static long total = 10000;
+static double duration, rate;
+static char *proxy, *base, *label;
+
+static long issued;                /* Requests handed out so far */
+static double start_ns, stop_ns;   /* stop_ns: end of a -d run */
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void sleep_until(double ns)
+{
+  struct timespec ts;
+
+  ts.tv_sec = (time_t)(ns / 1e9);
+  ts.tv_nsec = (long)(ns - ts.tv_sec * 1e9);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+static uint64_t xorshift(uint64_t *s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+static struct addrinfo *resolve(const char *host, const char *port)
+{
+  struct addrinfo hints, *res;
+  int rc;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if ((rc = getaddrinfo(host, port, &hints, &res)) != 0) {
+    fprintf(stderr, "%s:%s: %s\n", host, port, gai_strerror(rc));
+    exit(1);
+  }
+  return res;
+}
+
+static int find_group(const char *name)
+{
+  int g;
+
+  for (g = 0; g < num_groups; g++)
+    if (!strcmp(groups[g], name))
+      return g;
+  if (num_groups == MAX_GROUPS) {
+    fprintf(stderr, "more than %d URL groups\n", MAX_GROUPS);
+    exit(1);
+  }
+  groups[num_groups] = strdup(name);
+  return num_groups++;
+}
+
+/*
+ * add_url - add [url] (absolute, or a path joined to -b) to the mix,
+ *           in [group]
+ */
+static void add_url(const char *arg, const char *group)
+{
+  char full[MAXLINE], host[MAXLINE], port[32], path[MAXLINE], req[3 * MAXLINE];
+  slice h, p, pa, s;
+  url_t *u;
+
+  if (arg[0] == '/') {
+    if (!base) {
+      fprintf(stderr, "%s: a path needs -b http://host:port\n", arg);
+      exit(1);
+    }
+    snprintf(full, sizeof(full), "%s%s", base, arg);
+  }
+  else
+    snprintf(full, sizeof(full), "%s", arg);
+  s.ptr = full;
+  s.len = strlen(full);
+  if (phttp_parse_uri(s, &h, &p, &pa) < 0 || h.len >= sizeof(host) || p.len >= sizeof(port)) {
+    fprintf(stderr, "bad URL: %s\n", full);
+    exit(1);
+  }
+  if (num_urls == max_urls) {
+    max_urls = max_urls ? 2 * max_urls : 1024;
+    urls = realloc(urls, max_urls * sizeof(url_t));
+  }
+  sprintf(host, "%.*s", (int)h.len, h.ptr);
+  if (p.len)
+    sprintf(port, "%.*s", (int)p.len, p.ptr);
+  else
+    strcpy(port, "80");
+  sprintf(path, "%.*s", (int)pa.len, pa.ptr);
+
+  u = &urls[num_urls++];
+  u->url = strdup(full);
+  u->target = proxy ? u->url : strdup(path);
+  u->group = find_group(group);
+  snprintf(req, sizeof(req), "%s:%s", host, port);
+  u->origin = strdup(req);
+  if (proxy) {
+    static struct addrinfo *proxy_addr;
+    char phost[MAXLINE], *colon;
+
+    if (!proxy_addr) {
+      snprintf(phost, sizeof(phost), "%s", proxy);
+      if (!(colon = strrchr(phost, ':'))) {
+        fprintf(stderr, "-x wants host:port\n");
+        exit(1);
+      }
+      *colon = '\0';
+      proxy_addr = resolve(phost, colon + 1);
+    }
+    u->addr = proxy_addr;
+  }
+  else {
+    int i;
+
+    for (i = 0; i < num_origins; i++)
+      if (!strcmp(origins[i].name, u->origin))
+        break;
+    if (i == num_origins) {
+      if (num_origins == MAX_ORIGINS) {
+        fprintf(stderr, "more than %d origins\n", MAX_ORIGINS);
+        exit(1);
+      }
+      origins[i].name = u->origin;
+      origins[i].addr = resolve(host, port);
+      num_origins++;
+    }
+    u->addr = origins[i].addr;
+  }
+}
+
+/*
+ * load_trace - read the trace at [path], add its distinct URLs (moved
+ *              to -O's origin if given) and deal its records out to
+ *              the connections
+ */
+static void load_trace(const char *path, conn_t *cs)
+{
+  char url[2 * MAXLINE], *rest;
+  int *slots, nslots = 1, i, c;
+  unsigned long h;
+  long r;
+
+  if ((trace_len = trace_load(path, &trace)) <= 0) {
+    fprintf(stderr, "%s: empty or unreadable trace\n", path);
+    exit(1);
+  }
+  while (nslots < 2 * trace_len)
+    nslots *= 2;
+  slots = malloc(nslots * sizeof(int));       /* URL -> index in urls */
+  memset(slots, -1, nslots * sizeof(int));
+  trace_urls = malloc(trace_len * sizeof(int));
+  for (r = 0; r < trace_len; r++) {
+    if (trace_origin && !strncasecmp(trace[r].url, "http://", 7)) {
+      rest = trace[r].url + 7;
+      snprintf(url, sizeof(url), "http://%s/%s", trace_origin, rest);
+      if (trace[r].size >= 0)
+        sprintf(url + strlen(url), "%csize=%ld", strchr(rest, '?') ? '&' : '?', trace[r].size);
+    }
+    else
+      snprintf(url, sizeof(url), "%s", trace[r].url);
+    for (h = 5381, i = 0; url[i]; i++)
+      h = h * 33 + (unsigned char)url[i];
+    for (i = h & (nslots - 1); slots[i] >= 0 && strcmp(urls[slots[i]].url, url);
+         i = (i + 1) & (nslots - 1))
+      ;
+    if (slots[i] < 0) {
+      slots[i] = num_urls;
+      add_url(url, "all");
+    }
+    trace_urls[r] = slots[i];
+
+    c = trace[r].client % conns;
+    if (c < 0)
+      c += conns;
+    if (cs[c].num_recs % 1024 == 0)
+      cs[c].recs = realloc(cs[c].recs, (cs[c].num_recs + 1024) * sizeof(long));
+    cs[c].recs[cs[c].num_recs++] = r;
+  }
+  free(slots);
+}
+
+/*
+ * make_request - request bytes for urls[i] into buf; n numbers the
+ *                request, for -u
+ */
+static int make_request(char *buf, size_t size, int i, long n)
+{
+  url_t *u = &urls[i];
+  char bust[32] = "";
+
+  if (unique)
+    sprintf(bust, "%clg=%ld", strchr(u->target, '?') ? '&' : '?', n);
+  return snprintf(buf, size, "GET %s%s HTTP/1.1\r\n"
+                  "Host: %s\r\n"
+                  "User-Agent: loadgen\r\n"
+                  "%s\r\n",
+                  u->target, bust, u->origin, keepalive ? "" : "Connection: close\r\n");
+}
+
+static void load_urls(const char *path)
+{
+  FILE *fp;
+  char line[MAXLINE], *p, *url, *group;
+
+  if (!(fp = fopen(path, "r"))) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    if ((p = strchr(line, '#')))
+      *p = '\0';
+    if (!(url = strtok(line, " \t\r\n")))
+      continue;
+    group = strtok(NULL, " \t\r\n");
+    add_url(url, group ? group : "all");
+  }
+  fclose(fp);
+}
+
+static int dial(struct addrinfo *ai)
+{
+  struct timeval tv = { timeout_s, 0 };
+  int fd, one = 1;
+
+  for (; ai; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      return fd;
+    close(fd);
+  }
+  return -1;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = write(fd, buf, len)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * read_response - read one response from fd; returns its status with
+ *                 *reuse set if the connection can carry another
+ *                 request, 0 if the server closed before any byte
+ *                 (a stale keep-alive connection), or -1 on error
+ */
+static int read_response(int fd, char *buf, uint64_t *bytes, int *reuse)
+{
+  struct phttp_response resp;
+  size_t have = 0, need;
+  ssize_t n;
+  slice *v;
+  int hlen, status, close_delimited = 0;
+  long long clen = -1;
+
+  *reuse = 0;
+  while (1) {
+    if ((n = read(fd, buf + have, RESP_BUF - have)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0)
+      return have == 0 ? 0 : -1;
+    have += n;
+    if ((hlen = phttp_parse_response(buf, have, &resp)) >= 0)
+      break;
+    if (hlen != PHTTP_INCOMPLETE || have == RESP_BUF)
+      return -1;
+  }
+  status = resp.status;
+  if ((v = phttp_find_header(resp.headers, resp.num_headers, "Content-Length")))
+    clen = strtoll(v->ptr, NULL, 10);
+  else if (phttp_find_header(resp.headers, resp.num_headers, "Transfer-Encoding"))
+    return -1;                            /* Chunked bodies aren't supported */
+  else if (status != 204 && status != 304 && status >= 200)
+    close_delimited = 1;
+
+  if (keepalive && !close_delimited) {
+    v = phttp_find_header(resp.headers, resp.num_headers, "Connection");
+    if (phttp_slice_eq(resp.version, "HTTP/1.1"))
+      *reuse = !(v && v->len >= 5 && !strncasecmp(v->ptr, "close", 5));
+    else
+      *reuse = v && v->len >= 10 && !strncasecmp(v->ptr, "keep-alive", 10);
+  }
+
+  /* Drain the body: Content-Length bytes, or to EOF */
+  *bytes += have;
+  need = clen >= 0 ? (size_t)clen : 0;
+  have -= hlen;
+  while (close_delimited || have < need) {
+    if ((n = read(fd, buf, RESP_BUF)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0) {
+      if (close_delimited)
+        break;
+      return -1;
+    }
+    have += n;
+    *bytes += n;
+  }
+  if (have > need && !close_delimited)
+    *reuse = 0;                           /* Extra bytes: don't trust the connection */
+  return status;
+}
+
+/*
+ * next_url - the URL for connection c's next request and the time it
+ *            is due (0: now), or -1 when the run is over
+ */
+static int next_url(conn_t *c, uint64_t *seed, long *np, double *duep)
+{
+  static __thread double due;
+  double interval = rate > 0 ? conns / rate * 1e9 : 0;
+  long n;
+
+  if (trace) {
+    if (c->next_rec == c->num_recs)
+      return -1;
+    n = *np = c->recs[c->next_rec++];
+    *duep = start_ns + trace[n].ts / speed * 1e9;
+    return trace_urls[n];
+  }
+  n = __atomic_fetch_add(&issued, 1, __ATOMIC_RELAXED);
+  if (duration > 0 ? now_ns() >= stop_ns : n >= total)
+    return -1;
+  if (interval > 0) {                   /* Open loop: this connection's next slot */
+    if (due == 0)
+      due = start_ns + interval * c->id / conns;
+    *duep = due;
+    due += interval;                    /* The timeline doesn't wait for slow responses */
+  }
+  else
+    *duep = 0;
+  *np = n;
+  return sequential ? (int)(n % num_urls) : (int)(xorshift(seed) % num_urls);
+}
+
+static void *conn_thread(void *vargp)
+{
+  conn_t *c = vargp;
+  char *buf = malloc(RESP_BUF), req[3 * MAXLINE];
+  struct addrinfo *at = NULL;           /* Where fd is connected */
+  uint64_t seed = 0x9e3779b97f4a7c15ULL * (c->id + 1);
+  double due, sched, t0, t1;
+  int fd = -1, i, status, reuse, tries, len;
+  stats_t *st;
+  long n;
+
+  while ((i = next_url(c, &seed, &n, &due)) >= 0) {
+    t0 = now_ns();
+    if (due > t0) {                     /* Open loop or trace: wait until it is due */
+      sleep_until(due);
+      t0 = now_ns();
+    }
+    else if (due > 0 && t0 - due > 1e6)
+      c->late++;
+    sched = due > 0 ? due : t0;
+    len = make_request(req, sizeof(req), i, n);
+    st = &c->st[urls[i].group];
+    status = -1;
+    for (tries = 0; tries < 2 && status < 0; tries++) {
+      if (fd >= 0 && at != urls[i].addr) {
+        close(fd);
+        fd = -1;
+      }
+      if (fd < 0) {
+        if ((fd = dial(urls[i].addr)) < 0)
+          break;
+        at = urls[i].addr;
+        c->connects++;
+        tries = 1;                      /* A fresh connection gets no retry */
+      }
+      if (write_all(fd, req, len) == 0)
+        status = read_response(fd, buf, &c->bytes, &reuse);
+      if (status <= 0) {                /* 0: a reused connection went stale, retry once */
+        close(fd);
+        fd = -1;
+        status = -1;
+      }
+    }
+    t1 = now_ns();
+    if (status < 0) {
+      st->errors++;
+      continue;
+    }
+    hist_record(&st->lat, (uint64_t)((t1 - sched) / 1000));
+    hist_record(&st->svc, (uint64_t)((t1 - t0) / 1000));
+    st->ok++;
+    st->status[status / 100 < 6 ? status / 100 : 0]++;
+    if (!reuse) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0)
+    close(fd);
+  free(buf);
+  return NULL;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-c conns] [-n requests | -d secs] [-r rate] [-k 0|1]\n"
+          "       [-x proxyhost:port] [-b base] [-f urlfile] [-S] [-u]\n"
+          "       [-T trace [-s speed] [-O host:port]] [-t timeout] [-l label] [url...]\n"
+          "  -c  concurrent connections, one thread each (default 8)\n"
+          "  -n  total requests (default 10000); -d  run for secs instead\n"
+          "  -r  open loop: total requests/s spread over the connections (default closed loop)\n"
+          "  -k  keep connections alive between requests (default 1)\n"
+          "  -x  send requests through this proxy\n"
+          "  -b  base (http://host:port) for URLs that are just a path\n"
+          "  -f  file of URLs, one per line, each optionally followed by a group name\n"
+          "  -S  take URLs in order instead of at random\n"
+          "  -u  add a unique query parameter to every request (defeats caching)\n"
+          "  -T  replay this trace (JSON Lines) instead of a URL mix\n"
+          "  -s  replay the trace this many times faster (default 1)\n"
+          "  -O  send every trace URL to this origin (host:port), asking for its size\n"
+          "  -t  seconds before a connect/read/write counts as an error (default 10)\n"
+          "  -l  print one summary line per group, starting with label (for scripts)\n", prog);
+  exit(1);
+}
+
+static void merge_stats(stats_t *dst, const stats_t *src)
+{
+  int k;
+
+  hist_merge(&dst->lat, &src->lat);
+  hist_merge(&dst->svc, &src->svc);
+  dst->ok += src->ok;
+  dst->errors += src->errors;
+  for (k = 0; k < 6; k++)
+    dst->status[k] += src->status[k];
+}
+
+static void print_summary(const char *name, const stats_t *st, double secs)
+{
+  printf("%-24s %10.1f %9.3f %9.3f %9.3f %9.3f %7llu\n", name, st->ok / secs,
+         hist_percentile(&st->lat, 50) / 1e3, hist_percentile(&st->lat, 99) / 1e3,
+         hist_percentile(&st->lat, 99.9) / 1e3, st->lat.max / 1e3,
+         (unsigned long long)(st->errors + st->status[4] + st->status[5]));
+}
+
+static void print_stats(const char *name, const stats_t *st, double secs)
+{
+  if (name)
+    printf("[%s] %llu requests, %.1f req/s\n", name, (unsigned long long)st->ok, st->ok / secs);
+  printf("responses  2xx %llu  3xx %llu  4xx %llu  5xx %llu  errors %llu\n",
+         (unsigned long long)st->status[2], (unsigned long long)st->status[3],
+         (unsigned long long)st->status[4], (unsigned long long)st->status[5],
+         (unsigned long long)st->errors);
+  printf("latency    ");
+  hist_print(stdout, &st->lat, 1e3, "ms");
+  if (rate > 0 || trace) {
+    printf("service    ");
+    hist_print(stdout, &st->svc, 1e3, "ms");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  conn_t *cs;
+  stats_t *all, *st;
+  uint64_t connects = 0, late = 0, bytes = 0;
+  char name[MAXLINE], *urlfile = NULL, *tracefile = NULL;
+  double secs;
+  int c, g, i;
+
+  while ((c = getopt(argc, argv, "c:n:d:r:k:x:b:f:SuT:s:O:t:l:")) != -1) {
+    switch (c) {
+    case 'c': conns = atoi(optarg); break;
+    case 'n': total = atol(optarg); break;
+    case 'd': duration = atof(optarg); break;
+    case 'r': rate = atof(optarg); break;
+    case 'k': keepalive = atoi(optarg) != 0; break;
+    case 'x': proxy = optarg; break;
+    case 'b': base = optarg; break;
+    case 'f': urlfile = optarg; break;
+    case 'S': sequential = 1; break;
+    case 'u': unique = 1; break;
+    case 'T': tracefile = optarg; break;
+    case 's': speed = atof(optarg); break;
+    case 'O': trace_origin = optarg; break;
+    case 't': timeout_s = atoi(optarg); break;
+    case 'l': label = optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (conns <= 0 || speed <= 0)
+    usage(argv[0]);
+  cs = calloc(conns, sizeof(conn_t));
+  if (tracefile)
+    load_trace(tracefile, cs);
+  else {
+    if (urlfile)
+      load_urls(urlfile);
+    for (i = optind; i < argc; i++)
+      add_url(argv[i], "all");
+  }
+  if (num_urls == 0)
+    usage(argv[0]);
+
+  start_ns = now_ns();
+  stop_ns = start_ns + duration * 1e9;
+  for (i = 0; i < conns; i++) {
+    cs[i].id = i;
+    cs[i].st = malloc(num_groups * sizeof(stats_t));
+    for (g = 0; g < num_groups; g++) {
+      memset(&cs[i].st[g], 0, sizeof(stats_t));
+      hist_init(&cs[i].st[g].lat);
+      hist_init(&cs[i].st[g].svc);
+    }
+    pthread_create(&cs[i].tid, NULL, conn_thread, &cs[i]);
+  }
+
+  /* all[num_groups] is every group together */
+  all = calloc(num_groups + 1, sizeof(stats_t));
+  for (g = 0; g <= num_groups; g++) {
+    hist_init(&all[g].lat);
+    hist_init(&all[g].svc);
+  }
+  for (i = 0; i < conns; i++) {
+    pthread_join(cs[i].tid, NULL);
+    for (g = 0; g < num_groups; g++) {
+      merge_stats(&all[g], &cs[i].st[g]);
+      merge_stats(&all[num_groups], &cs[i].st[g]);
+    }
+    connects += cs[i].connects;
+    late += cs[i].late;
+    bytes += cs[i].bytes;
+  }
+  secs = (now_ns() - start_ns) / 1e9;
+  st = &all[num_groups];
+
+  if (label) {
+    if (num_groups == 1)
+      print_summary(label, st, secs);
+    else
+      for (g = 0; g < num_groups; g++) {
+        snprintf(name, sizeof(name), "%s/%s", label, groups[g]);
+        print_summary(name, &all[g], secs);
+      }
+    return 0;
+  }
+  printf("%d URL%s, %d connection%s, %s, %s%s\n", num_urls, num_urls > 1 ? "s" : "",
+         conns, conns > 1 ? "s" : "", keepalive ? "keep-alive" : "new connection per request",
+         trace ? "trace replay" : rate > 0 ? "open loop" : "closed loop",
+         proxy ? ", via proxy" : "");
+  printf("requests   %llu in %.3f s: %.1f req/s, %.2f MB/s, %llu connects\n",
+         (unsigned long long)st->ok, secs, st->ok / secs, bytes / secs / 1e6,
+         (unsigned long long)connects);
+  if (trace)
+    printf("schedule   %ld requests over %.3f s at %gx, %llu sent more than 1 ms late\n",
+           trace_len, trace[trace_len - 1].ts / speed, speed, (unsigned long long)late);
+  else if (rate > 0)
+    printf("schedule   %.1f req/s offered, %llu requests sent more than 1 ms late\n",
+           rate, (unsigned long long)late);
+  print_stats(NULL, st, secs);
+  if (num_groups > 1)
+    for (g = 0; g < num_groups; g++)
+      print_stats(groups[g], &all[g], secs);
+  return 0;
+}
@@ -0,0 +1,52 @@
+#!/usr/bin/python3
+
+# make-trace.py - Write a synthetic request trace (JSON Lines, see
+#                 trace.h) for loadgen -T and cachesim: Poisson
+#                 arrivals, Zipf popularity over a set of objects spread
+#                 across a few origins, log-normal object sizes (some
+#                 too big for the proxy's cache), and clients that each
+#                 keep to their own connection.
+#
+# usage: make-trace.py [-n requests] [-k objects] [-a zipf exponent]
+#                      [-r requests/s] [-c clients] [-o origins]
+#                      [--seed n] > trace.jsonl
+#
+import argparse
+import bisect
+import json
+import math
+import random
+
+parser = argparse.ArgumentParser(description='Synthetic request trace')
+parser.add_argument('-n', type=int, default=20000, help='requests')
+parser.add_argument('-k', type=int, default=2000, help='distinct objects')
+parser.add_argument('-a', type=float, default=0.8, help='Zipf exponent')
+parser.add_argument('-r', type=float, default=200, help='mean requests/s')
+parser.add_argument('-c', type=int, default=32, help='clients')
+parser.add_argument('-o', type=int, default=4, help='origins')
+parser.add_argument('--seed', type=int, default=1)
+args = parser.parse_args()
+
+random.seed(args.seed)
+
+# Object k: its origin, path and size (median 8 KB, ~5% over 100 KB)
+objects = []
+for k in range(args.k):
+  origin = 'http://origin%d.example:8080' % random.randrange(args.o)
+  ext = random.choice(['html', 'css', 'js', 'png', 'jpg', 'json'])
+  size = int(random.lognormvariate(math.log(8192), 1.5))
+  objects.append(('%s/static/%d.%s' % (origin, k, ext), size))
+random.shuffle(objects)                 # Popularity unrelated to size
+
+cdf = []
+total = 0.0
+for k in range(args.k):
+  total += 1 / (k + 1) ** args.a
+  cdf.append(total)
+
+ts = 0.0
+for i in range(args.n):
+  ts += random.expovariate(args.r)
+  url, size = objects[bisect.bisect_left(cdf, random.random() * total)]
+  print(json.dumps({'ts': round(ts, 6), 'url': url, 'size': size,
+                    'client': random.randrange(args.c)}))
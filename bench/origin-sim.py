@@ -0,0 +1,165 @@
+#!/usr/bin/python3
+
+# origin-sim.py - A misbehaving origin server for the proxy benchmarks.
+#                 nop-server.py only models an origin that never
+#                 answers; this one can be slow in the ways real ones
+#                 are: a delay before the first byte (fixed or drawn
+#                 from a distribution), a trickling body, a connection
+#                 reset part way through the body, large bodies, or no
+#                 answer at all. Each connection gets its own thread.
+#
+# usage: origin-sim.py [options] <port>
+#
+# The options set the defaults; any request can override them in its
+# query string, so one simulator serves healthy and sick "origins" side
+# by side (distinct paths also keep the proxy's cache apart):
+#
+#   /healthy?size=2000
+#   /slow?delay=200&dist=exp          exponential delay, mean 200 ms
+#   /trickle?size=500000&bw=20000     500 KB at 20 KB/s
+#   /reset?size=200000&reset=0.5      RST after half the body
+#   /hang?hang=1                      read the request, never answer
+#
+import argparse
+import random
+import socket
+import socketserver
+import struct
+import sys
+import time
+import urllib.parse
+
+BLOCK = bytes(range(256)) * 256        # 64 KB of body to repeat
+TICK = 0.05                            # Trickle in 50 ms steps
+
+parser = argparse.ArgumentParser(description='Simulated origin server')
+parser.add_argument('port', type=int)
+parser.add_argument('--delay', type=float, default=0.0,
+                    help='delay before the response, ms (mean for dist)')
+parser.add_argument('--dist', default='fixed',
+                    choices=['fixed', 'uniform', 'exp', 'pareto'],
+                    help='fixed: always delay; uniform: 0..2*delay; '
+                    'exp: exponential; pareto: heavy tail (alpha 1.5)')
+parser.add_argument('--size', type=int, default=1024,
+                    help='body size, bytes')
+parser.add_argument('--bw', type=float, default=0.0,
+                    help='send the body at this many bytes/s (0: at once)')
+parser.add_argument('--reset', type=float, default=0.0,
+                    help='reset the connection after this fraction of the '
+                    'body (0: never)')
+parser.add_argument('--hang', type=int, default=0,
+                    help='1: never answer')
+parser.add_argument('--status', type=int, default=200)
+defaults = parser.parse_args()
+
+
+def draw_delay(mean, dist):
+  """Seconds to wait before answering"""
+  if mean <= 0:
+    return 0
+  if dist == 'uniform':
+    ms = random.uniform(0, 2 * mean)
+  elif dist == 'exp':
+    ms = random.expovariate(1 / mean)
+  elif dist == 'pareto':
+    ms = mean / 3 * random.paretovariate(1.5)   # Mean of Pareto(1.5) is 3
+  else:
+    ms = mean
+  return ms / 1000
+
+
+def settings(target):
+  """The defaults, overridden by the request's query string"""
+  s = vars(defaults).copy()
+  query = urllib.parse.urlsplit(target).query
+  for key, values in urllib.parse.parse_qs(query).items():
+    if key in s and key != 'port':
+      try:
+        s[key] = type(s[key])(values[-1])
+      except ValueError:
+        pass
+  return s
+
+
+class Handler(socketserver.BaseRequestHandler):
+  def read_request(self):
+    """Request line and headers, or None at EOF"""
+    while b'\r\n\r\n' not in self.buf:
+      data = self.request.recv(65536)
+      if not data:
+        return None
+      self.buf += data
+    head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+    lines = head.decode('latin-1').split('\r\n')
+    parts = lines[0].split()
+    if len(parts) != 3:
+      return None
+    headers = {}
+    for line in lines[1:]:
+      name, _, value = line.partition(':')
+      headers[name.strip().lower()] = value.strip()
+    return parts, headers
+
+  def send_body(self, s):
+    size = s['size']
+    stop = int(size * s['reset']) if s['reset'] > 0 else size
+    step = int(s['bw'] * TICK) if s['bw'] > 0 else len(BLOCK)
+    sent = 0
+    while sent < stop:
+      n = min(step, stop - sent, len(BLOCK))
+      self.request.sendall(BLOCK[:n])
+      sent += n
+      if s['bw'] > 0:
+        time.sleep(TICK)
+    if stop < size:
+      # SO_LINGER with a zero timeout turns close() into a RST
+      self.request.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER,
+                              struct.pack('ii', 1, 0))
+      return False
+    return True
+
+  def handle(self):
+    self.buf = b''
+    self.request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    try:
+      while True:
+        req = self.read_request()
+        if req is None:
+          return
+        (method, target, version), headers = req
+        s = settings(target)
+        if s['hang']:
+          while self.request.recv(65536):     # Until the client gives up
+            pass
+          return
+        time.sleep(draw_delay(s['delay'], s['dist']))
+        conn = headers.get('connection', '').lower()
+        keep = (version == 'HTTP/1.1' and conn != 'close') or conn == 'keep-alive'
+        self.request.sendall(('HTTP/1.1 %d Sim\r\n'
+                              'Server: origin-sim\r\n'
+                              'Content-Type: application/octet-stream\r\n'
+                              'Content-Length: %d\r\n'
+                              'Connection: %s\r\n\r\n'
+                              % (s['status'], s['size'],
+                                 'keep-alive' if keep else 'close')).encode())
+        if method == 'HEAD':
+          pass
+        elif not self.send_body(s):
+          return
+        if not keep:
+          return
+    except (ConnectionError, OSError):
+      return
+
+
+class Server(socketserver.ThreadingTCPServer):
+  daemon_threads = True
+  allow_reuse_address = True
+  request_queue_size = 1024
+
+
+if __name__ == '__main__':
+  try:
+    Server(('', defaults.port), Handler).serve_forever()
+  except KeyboardInterrupt:
+    sys.exit(0)
@@ -0,0 +1,238 @@
+/*
+ * parse-bench.c - microbenchmark for the proxy's request tokenizer
+ *
+ * Tokenizes a corpus of realistic proxy requests over and over with
+ * every scanner phttp supports on this CPU, plus the sscanf/strstr
+ * parsing the proxy used before phttp, and reports ns per request and
+ * MB/s for each.
+ *
+ * usage: parse-bench [-n iterations] [corpus-file]
+ *
+ * A corpus file holds requests separated by blank lines; line endings
+ * are converted to CRLF on load. Without one, a built-in corpus is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "phttp.h"
+
+#define MAXLINE 8192
+#define MAX_CORPUS 256
+
+/* Built-in corpus: what browsers, curl and the driver send a proxy */
+static const char *builtin[] = {
+  "GET http://localhost:15213/home.html HTTP/1.0\r\n"
+  "Host: localhost:15213\r\n"
+  "User-Agent: curl/7.88.1\r\n"
+  "Accept: */*\r\n"
+  "Proxy-Connection: Keep-Alive\r\n"
+  "\r\n",
+
+  "GET http://www.example.com/ HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Connection: keep-alive\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "Sec-Fetch-Dest: document\r\n"
+  "Sec-Fetch-Mode: navigate\r\n"
+  "Sec-Fetch-Site: none\r\n"
+  "Sec-Fetch-User: ?1\r\n"
+  "\r\n",
+
+  "GET http://static.example.com:8080/assets/js/vendor.bundle.min.js?v=3f2a9c1e HTTP/1.1\r\n"
+  "Host: static.example.com:8080\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+  "Accept: */*\r\n"
+  "Referer: http://www.example.com/dashboard/overview?tab=metrics&range=24h\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Accept-Language: ko-KR,ko;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+  "Cookie: session=9b1f0c3e7d2a4b6c8e0f1a2b3c4d5e6f; _ga=GA1.2.1234567890.1697000000; _gid=GA1.2.987654321.1697600000; theme=dark; consent=analytics%2Cfunctional\r\n"
+  "If-None-Match: \"5f8d-6b2c1a9e3f4d0\"\r\n"
+  "If-Modified-Since: Tue, 17 Oct 2023 08:12:44 GMT\r\n"
+  "Proxy-Connection: keep-alive\r\n"
+  "\r\n",
+
+  "GET http://localhost:15214/cgi-bin/adder?arg1=15000&arg2=213 HTTP/1.0\r\n"
+  "Host: localhost:15214\r\n"
+  "\r\n",
+
+  "GET http://media.example.com/video/rain.mp4 HTTP/1.1\r\n"
+  "Host: media.example.com\r\n"
+  "User-Agent: VLC/3.0.18 LibVLC/3.0.18\r\n"
+  "Range: bytes=1048576-\r\n"
+  "Icy-MetaData: 1\r\n"
+  "Accept: */*\r\n"
+  "Connection: close\r\n"
+  "\r\n",
+};
+
+static char *corpus[MAX_CORPUS];
+static size_t corpus_len[MAX_CORPUS];
+static int num_corpus;
+static size_t corpus_bytes;
+
+/* Defeats dead-code elimination of the parse results */
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void add_request(const char *req, size_t len)
+{
+  if (num_corpus == MAX_CORPUS)
+    return;
+  corpus[num_corpus] = malloc(len + 1);
+  memcpy(corpus[num_corpus], req, len);
+  corpus[num_corpus][len] = '\0';
+  corpus_len[num_corpus] = len;
+  corpus_bytes += len;
+  num_corpus++;
+}
+
+/*
+ * load_corpus - read blank-line separated requests from [path],
+ *               converting LF line endings to CRLF
+ */
+static void load_corpus(const char *path)
+{
+  FILE *fp;
+  char line[MAXLINE], req[MAXLINE * 4];
+  size_t len = 0, n;
+
+  if (!(fp = fopen(path, "r"))) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    n = strcspn(line, "\r\n");
+    if (len + n + 4 > sizeof(req))
+      continue;
+    memcpy(req + len, line, n);
+    len += n;
+    req[len++] = '\r';
+    req[len++] = '\n';
+    if (n == 0) {
+      if (len > 2)
+        add_request(req, len);
+      len = 0;
+    }
+  }
+  if (len > 2) {
+    req[len++] = '\r';
+    req[len++] = '\n';
+    add_request(req, len);
+  }
+  fclose(fp);
+}
+
+/*
+ * legacy_parse - the proxy's original parsing: sscanf the request line,
+ *                strstr/sscanf the uri, then walk header lines
+ */
+static size_t legacy_parse(const char *buf)
+{
+  char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+  char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+  const char *line, *eol, *colon, *ptr;
+  size_t n = 0;
+
+  sscanf(buf, "%s %s %s", method, uri, version);
+  host[0] = port[0] = path[0] = '\0';
+  if ((ptr = strstr(uri, "://"))) {
+    sscanf(ptr + 3, "%[^:/]:%[^/]%s", host, port, path);
+    if (strcmp(port, "") == 0)
+      strcpy(port, "80");
+    if (strcmp(path, "") == 0)
+      strcpy(path, "/");
+  }
+  line = strstr(buf, "\r\n") + 2;
+  while ((eol = strstr(line, "\r\n")) && eol != line) {
+    if ((colon = strchr(line, ':')) && colon < eol)
+      n += colon - line;
+    line = eol + 2;
+  }
+  return n + strlen(host) + strlen(path);
+}
+
+/*
+ * phttp_run - tokenize a request and its uri with the current scanner
+ */
+static size_t phttp_run(const char *buf, size_t len)
+{
+  struct phttp_request req;
+  slice host, port, path;
+  size_t n = 0;
+  int i;
+
+  if (phttp_parse_request(buf, len, &req) < 0)
+    return 0;
+  phttp_parse_uri(req.uri, &host, &port, &path);
+  for (i = 0; i < req.num_headers; i++)
+    n += req.headers[i].name.len;
+  return n + host.len + path.len;
+}
+
+static void report(const char *name, long iters, double ns)
+{
+  double reqs = (double)iters * num_corpus;
+
+  printf("%-8s %10.1f ns/req %10.1f MB/s\n", name, ns / reqs,
+         (double)iters * corpus_bytes / (ns / 1e9) / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+  const char *impls[] = { "scalar", "sse4.2", "avx2" };
+  long iters = 200000, it;
+  double start;
+  size_t i, j;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:")) != -1) {
+    if (c == 'n')
+      iters = atol(optarg);
+    else {
+      fprintf(stderr, "usage: %s [-n iterations] [corpus-file]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (optind < argc)
+    load_corpus(argv[optind]);
+  else
+    for (i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++)
+      add_request(builtin[i], strlen(builtin[i]));
+  if (num_corpus == 0) {
+    fprintf(stderr, "empty corpus\n");
+    exit(1);
+  }
+  printf("corpus: %d requests, %zu bytes; default scanner: %s\n",
+         num_corpus, corpus_bytes, phttp_impl());
+
+  start = now_ns();
+  for (it = 0; it < iters; it++)
+    for (c = 0; c < num_corpus; c++)
+      sink += legacy_parse(corpus[c]);
+  report("legacy", iters, now_ns() - start);
+
+  for (j = 0; j < sizeof(impls) / sizeof(impls[0]); j++) {
+    if (phttp_select(impls[j]) < 0) {
+      printf("%-8s unsupported on this CPU\n", impls[j]);
+      continue;
+    }
+    start = now_ns();
+    for (it = 0; it < iters; it++)
+      for (c = 0; c < num_corpus; c++)
+        sink += phttp_run(corpus[c], corpus_len[c]);
+    report(impls[j], iters, now_ns() - start);
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# scenarios.sh - Latency/throughput scenarios for tiny and the proxy,
+#     driven by loadgen. Starts a prethreaded tiny and the proxy on free
+#     ports, puts a set of distinct test files (all small enough for the
+#     proxy's cache, and together within it) under tiny/, and runs:
+#
+#       tiny direct, keep-alive        closed loop, C connections
+#       tiny direct, no keep-alive     a new connection per request
+#       tiny direct, open loop         the same at a fixed rate (-r)
+#       proxy, cold cache              fresh proxy, one pass over the files
+#       proxy, warm cache              the same pass again (all hits)
+#       proxy, warm, C conns           N random requests over the files
+#       proxy, cold, C conns           the same from a fresh proxy (the
+#                                      first touch of each file misses)
+#
+#     Prints one line per scenario: req/s, p50/p99/p99.9/max latency in
+#     ms, and errors (including 4xx/5xx responses).
+#
+#     usage: ./scenarios.sh [-n requests] [-c connections] [-r rate] [-f files]
+#            (run from bench/)
+#
+
+REQUESTS=5000
+CONNS=8
+RATE=2000
+NFILES=40
+TINY_PORT=`../free-port.sh`
+PROXY_PORT=$((TINY_PORT + 1))
+
+while getopts "n:c:r:f:" opt; do
+    case $opt in
+        n) REQUESTS=$OPTARG ;;
+        c) CONNS=$OPTARG ;;
+        r) RATE=$OPTARG ;;
+        f) NFILES=$OPTARG ;;
+        *) echo "usage: $0 [-n requests] [-c connections] [-r rate] [-f files]"; exit 1 ;;
+    esac
+done
+
+(cd ..; make -s proxy) && (cd ../tiny; make -s tiny) && make -s loadgen || exit 1
+
+tiny_pid=
+proxy_pid=
+dir=`mktemp -d ../tiny/bench.XXXXXX`
+urls=`mktemp`
+trap 'kill $tiny_pid $proxy_pid 2> /dev/null; rm -rf $dir $urls' EXIT
+
+#
+# start_proxy - (re)start the proxy, so its cache is empty
+#
+function start_proxy {
+    if [ -n "$proxy_pid" ]; then
+        kill $proxy_pid
+        wait $proxy_pid 2> /dev/null
+    fi
+    ../proxy $PROXY_PORT > /dev/null 2>&1 &
+    proxy_pid=$!
+    sleep 0.3
+}
+
+# 1KB..24KB files: 40 of them average ~12KB, well under MAX_CACHE_SIZE
+for i in `seq $NFILES`; do
+    head -c $(( (i * 7919 % 24 + 1) * 1024 )) /dev/urandom > $dir/f$i.bin
+    echo "http://localhost:${TINY_PORT}/`basename $dir`/f$i.bin" >> $urls
+done
+
+(cd ../tiny; exec ./tiny -m thread -n $CONNS $TINY_PORT > /dev/null 2>&1) &
+tiny_pid=$!
+start_proxy
+
+printf "%-24s %10s %9s %9s %9s %9s %7s\n" scenario "req/s" "p50 ms" "p99 ms" "p99.9 ms" "max ms" errors
+./loadgen -l "tiny keep-alive" -c $CONNS -n $REQUESTS -f $urls
+./loadgen -l "tiny no keep-alive" -c $CONNS -n $REQUESTS -k 0 -f $urls
+./loadgen -l "tiny open loop ${RATE}/s" -c $CONNS -n $REQUESTS -r $RATE -f $urls
+./loadgen -l "proxy cold cache" -c 1 -n $NFILES -S -x localhost:$PROXY_PORT -f $urls
+./loadgen -l "proxy warm cache" -c 1 -n $NFILES -S -x localhost:$PROXY_PORT -f $urls
+./loadgen -l "proxy warm, ${CONNS} conns" -c $CONNS -n $REQUESTS -x localhost:$PROXY_PORT -f $urls
+start_proxy
+./loadgen -l "proxy cold, ${CONNS} conns" -c $CONNS -n $REQUESTS -x localhost:$PROXY_PORT -f $urls
+exit 0
@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# slow-origins.sh - How the proxy's latency for healthy origins holds up
+#     while other origins misbehave. Starts two origin-sim.py servers, a
+#     healthy one and a sick one, and the proxy. Healthy requests are
+#     sent open-loop at a fixed rate (loadgen -r, unique URIs so that
+#     the cache can't answer them), first alone and then alongside
+#     closed-loop clients of the sick origin: slow first bytes (Pareto
+#     delays), trickled bodies, resets mid-body and requests that are
+#     never answered.
+#
+#     Latency is from the time each healthy request was due, so a proxy
+#     that stalls shows up in the percentiles instead of just lowering
+#     the request count.
+#
+#     usage: ./slow-origins.sh [-r rate] [-d secs] [-c sick clients]
+#            (run from bench/)
+#
+
+RATE=200
+SECS=10
+SICK=16
+PORT=`../free-port.sh`
+HEALTHY_PORT=$PORT
+SICK_PORT=$((PORT + 1))
+PROXY_PORT=$((PORT + 2))
+
+while getopts "r:d:c:" opt; do
+    case $opt in
+        r) RATE=$OPTARG ;;
+        d) SECS=$OPTARG ;;
+        c) SICK=$OPTARG ;;
+        *) echo "usage: $0 [-r rate] [-d secs] [-c sick clients]"; exit 1 ;;
+    esac
+done
+
+(cd ..; make -s proxy) && make -s loadgen || exit 1
+
+sick_urls=`mktemp`
+trap 'kill $healthy_pid $sick_pid $proxy_pid 2> /dev/null; rm -f $sick_urls' EXIT
+
+cat > $sick_urls <<EOF
+http://localhost:${SICK_PORT}/slow?delay=500&dist=pareto          slow
+http://localhost:${SICK_PORT}/trickle?size=400000&bw=50000        trickle
+http://localhost:${SICK_PORT}/reset?size=300000&reset=0.5         reset
+http://localhost:${SICK_PORT}/hang?hang=1                         hang
+EOF
+
+./origin-sim.py --size 4096 $HEALTHY_PORT > /dev/null 2>&1 &
+healthy_pid=$!
+./origin-sim.py $SICK_PORT > /dev/null 2>&1 &
+sick_pid=$!
+../proxy $PROXY_PORT > /dev/null 2>&1 &
+proxy_pid=$!
+sleep 1
+
+healthy="-c 8 -r $RATE -d $SECS -u -x localhost:$PROXY_PORT http://localhost:${HEALTHY_PORT}/healthy"
+
+printf "%-24s %10s %9s %9s %9s %9s %7s\n" scenario "req/s" "p50 ms" "p99 ms" "p99.9 ms" "max ms" errors
+./loadgen -l "healthy alone" $healthy
+
+./loadgen -l "sick" -c $SICK -d $SECS -t 3 -u -x localhost:$PROXY_PORT -f $sick_urls > /tmp/sick.$$ &
+sick_load=$!
+sleep 0.5
+./loadgen -l "healthy with sick" $healthy
+wait $sick_load
+cat /tmp/sick.$$
+rm -f /tmp/sick.$$
+exit 0
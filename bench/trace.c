@@ -0,0 +1,98 @@
+/*
+ * trace.c - load JSON Lines request traces (see trace.h)
+ *
+ * Only flat objects with string and number values are understood,
+ * which is all a trace needs; there is no general JSON parser here.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define MAXLINE 8192
+
+/*
+ * find_value - the value of "key" in the object on [line]: a pointer
+ *              just past the ':' and any blanks, or NULL
+ */
+static char *find_value(char *line, const char *key)
+{
+  size_t len = strlen(key);
+  char *p = line;
+
+  while ((p = strchr(p, '"'))) {
+    if (!strncmp(p + 1, key, len) && p[len + 1] == '"') {
+      p += len + 2;
+      p += strspn(p, " \t");
+      if (*p != ':')
+        return NULL;
+      p++;
+      return p + strspn(p, " \t");
+    }
+    if (!(p = strchr(p + 1, '"')))     /* Skip the rest of this string */
+      return NULL;
+    p++;
+  }
+  return NULL;
+}
+
+/* A JSON string value (escapes other than \" and \\ kept as is) */
+static char *string_value(char *p)
+{
+  char *out, *q;
+
+  if (*p++ != '"')
+    return NULL;
+  out = q = malloc(strlen(p) + 1);
+  while (*p && *p != '"') {
+    if (*p == '\\' && (p[1] == '"' || p[1] == '\\' || p[1] == '/'))
+      p++;
+    *q++ = *p++;
+  }
+  *q = '\0';
+  return out;
+}
+
+/*
+ * trace_load - read the trace at [path] into a malloc'd array;
+ *              returns the number of records or -1 (with a message)
+ */
+long trace_load(const char *path, trace_rec_t **recsp)
+{
+  FILE *fp;
+  char line[MAXLINE], *v;
+  trace_rec_t *recs = NULL, *r;
+  long n = 0, size = 0, lineno = 0;
+
+  if (!(fp = fopen(path, "r"))) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    lineno++;
+    if (line[strspn(line, " \t\r\n")] == '\0')
+      continue;
+    if (n == size) {
+      size = size ? size * 2 : 1024;
+      recs = realloc(recs, size * sizeof(trace_rec_t));
+    }
+    r = &recs[n];
+    if (!(v = find_value(line, "url")) || !(r->url = string_value(v))) {
+      fprintf(stderr, "%s:%ld: no \"url\"\n", path, lineno);
+      fclose(fp);
+      return -1;
+    }
+    r->ts = (v = find_value(line, "ts")) ? atof(v) : 0;
+    r->size = (v = find_value(line, "size")) ? atol(v) : -1;
+    r->client = (v = find_value(line, "client")) ? atoi(v) : 0;
+    if (n > 0 && r->ts < recs[n - 1].ts) {
+      fprintf(stderr, "%s:%ld: ts goes backwards\n", path, lineno);
+      fclose(fp);
+      return -1;
+    }
+    n++;
+  }
+  fclose(fp);
+  *recsp = recs;
+  return n;
+}
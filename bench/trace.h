@@ -0,0 +1,25 @@
+/*
+ * trace.h - request traces for replay and cache simulation
+ *
+ * A trace is JSON Lines, one request per line:
+ *
+ *   {"ts": 12.503, "url": "http://host:port/path", "size": 5120, "client": 7}
+ *
+ * ts is seconds from the start of the trace, size the response body in
+ * bytes (-1 if unknown) and client identifies who sent it (requests of
+ * one client are replayed in order on one connection). Other fields
+ * are ignored; records must be in ts order.
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+typedef struct {
+  double ts;
+  char *url;
+  long size;
+  int client;
+} trace_rec_t;
+
+long trace_load(const char *path, trace_rec_t **recsp);
+
+#endif
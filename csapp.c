@@ -42,7 +42,7 @@ void posix_error(int code, char *msg) /* Posix-style error */
     exit(0);
 }
 
-void gai_error(int code, char *msg) /* Getaddrinfo-style error */
+void eai_error(int code, char *msg) /* Getaddrinfo-style error */
 {
     fprintf(stderr, "%s: %s\n", msg, gai_strerror(code));
     exit(0);
@@ -605,7 +605,7 @@ void Getaddrinfo(const char *node, const char *service,
     int rc;
 
     if ((rc = getaddrinfo(node, service, hints, res)) != 0) 
-        gai_error(rc, "Getaddrinfo error");
+        eai_error(rc, "Getaddrinfo error");
 }
 /* $end getaddrinfo */
 
@@ -616,7 +616,7 @@ void Getnameinfo(const struct sockaddr *sa, socklen_t salen, char *host,
 
     if ((rc = getnameinfo(sa, salen, host, hostlen, serv, 
                           servlen, flags)) != 0) 
-        gai_error(rc, "Getnameinfo error");
+        eai_error(rc, "Getnameinfo error");
 }
 
 void Freeaddrinfo(struct addrinfo *res)
@@ -716,6 +716,42 @@ void Pthread_once(pthread_once_t *once_control, void (*init_function)()) {
     pthread_once(once_control, init_function);
 }
 
+/**********************************************
+ * Wrappers for Pthreads readers-writer locks
+ **********************************************/
+
+void Pthread_rwlock_init(pthread_rwlock_t *lock, const pthread_rwlockattr_t *attr) 
+{
+    int rc;
+
+    if ((rc = pthread_rwlock_init(lock, attr)) != 0)
+	posix_error(rc, "Pthread_rwlock_init error");
+}
+
+void Pthread_rwlock_rdlock(pthread_rwlock_t *lock) 
+{
+    int rc;
+
+    if ((rc = pthread_rwlock_rdlock(lock)) != 0)
+	posix_error(rc, "Pthread_rwlock_rdlock error");
+}
+
+void Pthread_rwlock_wrlock(pthread_rwlock_t *lock) 
+{
+    int rc;
+
+    if ((rc = pthread_rwlock_wrlock(lock)) != 0)
+	posix_error(rc, "Pthread_rwlock_wrlock error");
+}
+
+void Pthread_rwlock_unlock(pthread_rwlock_t *lock) 
+{
+    int rc;
+
+    if ((rc = pthread_rwlock_unlock(lock)) != 0)
+	posix_error(rc, "Pthread_rwlock_unlock error");
+}
+
 /*******************************
  * Wrappers for Posix semaphores
  *******************************/
@@ -792,6 +828,118 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_iovadvance - Drop n written bytes from the front of an iovec
+ *    array: skip the entries sent in full and trim the one sent in
+ *    part. Returns the number of entries left.
+ */
+static int rio_iovadvance(struct iovec **iovp, int iovcnt, size_t n)
+{
+    struct iovec *iov = *iovp;
+
+    while (iovcnt > 0 && n >= iov->iov_len) {
+	n -= iov->iov_len;
+	iov++;
+	iovcnt--;
+    }
+    if (iovcnt > 0) {
+	iov->iov_base = (char *)iov->iov_base + n;
+	iov->iov_len -= n;
+    }
+    *iovp = iov;
+    return iovcnt;
+}
+
+/*
+ * rio_writev - Robustly write every byte of an iovec array (unbuffered)
+ *    with as few writev() calls as possible. The iovec array is
+ *    consumed (modified) as it is written.
+ */
+/* $begin rio_writev */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt) 
+{
+    ssize_t nwritten, total = 0;
+
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;        /* and call writev() again */
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	total += nwritten;
+	iovcnt = rio_iovadvance(&iov, iovcnt, nwritten);
+    }
+    return total;
+}
+/* $end rio_writev */
+
+/*
+ * rio_sendv - Like rio_writev, but for sockets, with send() flags.
+ *    Pass MSG_MORE when more data (e.g. a body after a header block)
+ *    follows right away, so the kernel coalesces them into full
+ *    segments.
+ */
+/* $begin rio_sendv */
+ssize_t rio_sendv(int fd, struct iovec *iov, int iovcnt, int flags) 
+{
+    struct msghdr msg;
+    ssize_t nsent, total = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    while (iovcnt > 0) {
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+	if ((nsent = sendmsg(fd, &msg, flags)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;        /* and call sendmsg() again */
+	    else
+		return -1;       /* errno set by sendmsg() */
+	}
+	total += nsent;
+	iovcnt = rio_iovadvance(&iov, iovcnt, nsent);
+    }
+    return total;
+}
+/* $end rio_sendv */
+
+/*
+ * rio_cork - Set (on=1) or clear (on=0) TCP_CORK on a socket. While
+ *    corked, partial segments are held back; clearing it flushes them.
+ */
+/* $begin rio_cork */
+int rio_cork(int fd, int on) 
+{
+    return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+}
+/* $end rio_cork */
+
+/*
+ * rio_sendfile - Robustly send n bytes of file infd, starting at
+ *    *offset, to outfd with sendfile() (no user-space copy). *offset is
+ *    advanced past what was sent, so after an error the caller can
+ *    tell how much got through. Returns n, or -1 on error.
+ */
+/* $begin rio_sendfile */
+ssize_t rio_sendfile(int outfd, int infd, off_t *offset, size_t n) 
+{
+    size_t nleft = n;
+    ssize_t nsent;
+
+    while (nleft > 0) {
+	if ((nsent = sendfile(outfd, infd, offset, nleft)) <= 0) {
+	    if (nsent < 0 && errno == EINTR) /* Interrupted by sig handler return */
+		continue;                    /* and call sendfile() again */
+	    if (nsent == 0)                  /* File shrank under us */
+		errno = EIO;
+	    return -1;                       /* errno set by sendfile() */
+	}
+	nleft -= nsent;
+    }
+    return n;
+}
+/* $end rio_sendfile */
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -893,6 +1041,188 @@ ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 }
 /* $end rio_readlineb */
 
+/*
+ * The Riox functions are the buffered Rio functions over a riox_t,
+ * whose buffer size is chosen by the caller: large for bulk transfers
+ * (fewer read() calls), small or none at all for idle descriptors.
+ */
+
+/*
+ * riox_fill - Refill an empty riox buffer with one read(). Returns the
+ *    number of unread bytes, 0 on EOF, -1 on error (errno set, or
+ *    EINVAL if the buffer is parked).
+ */
+static ssize_t riox_fill(riox_t *rp)
+{
+    ssize_t n;
+
+    if (rp->rio_cnt > 0)
+	return rp->rio_cnt;
+    if (!rp->rio_buf) {
+	errno = EINVAL;
+	return -1;
+    }
+    while ((n = read(rp->rio_fd, rp->rio_buf, rp->rio_bufsize)) < 0)
+	if (errno != EINTR) /* Interrupted by sig handler return */
+	    return -1;
+    rp->rio_bufptr = rp->rio_buf;
+    rp->rio_cnt = n;
+    return n;
+}
+
+/*
+ * riox_readinitb - Associate a descriptor with a read buffer of size
+ *    bytes. If buf is NULL, one is Malloc'd and freed by riox_free.
+ */
+void riox_readinitb(riox_t *rp, int fd, char *buf, size_t size) 
+{
+    rp->rio_fd = fd;
+    rp->rio_cnt = 0;
+    rp->rio_owned = (buf == NULL);
+    rp->rio_buf = buf ? buf : Malloc(size);
+    rp->rio_bufptr = rp->rio_buf;
+    rp->rio_bufsize = size;
+}
+
+/*
+ * riox_readnb - Robustly read n bytes (buffered). Once the buffer is
+ *    drained, reads of at least a full buffer go straight into usrbuf.
+ */
+ssize_t riox_readnb(riox_t *rp, void *usrbuf, size_t n) 
+{
+    size_t nleft = n, cnt;
+    ssize_t nread;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if (rp->rio_cnt == 0 && nleft >= rp->rio_bufsize) {
+	    if ((nread = rio_readn(rp->rio_fd, bufp, nleft)) < 0)
+		return -1;      /* errno set by read() */
+	    return (n - nleft) + nread;
+	}
+	if ((nread = riox_fill(rp)) < 0)
+	    return -1;          /* errno set by read() */
+	else if (nread == 0)
+	    break;              /* EOF */
+	cnt = nleft < rp->rio_cnt ? nleft : rp->rio_cnt;
+	memcpy(bufp, rp->rio_bufptr, cnt);
+	rp->rio_bufptr += cnt;
+	rp->rio_cnt -= cnt;
+	nleft -= cnt;
+	bufp += cnt;
+    }
+    return (n - nleft);         /* return >= 0 */
+}
+
+/*
+ * riox_readlineb - Robustly read a text line (buffered), searching the
+ *    buffer with memchr rather than copying a byte at a time
+ */
+ssize_t riox_readlineb(riox_t *rp, void *usrbuf, size_t maxlen) 
+{
+    size_t n = 0, cnt;
+    ssize_t rc;
+    char *bufp = usrbuf, *nl;
+
+    while (n + 1 < maxlen) {
+	if ((rc = riox_fill(rp)) < 0)
+	    return -1;          /* Error */
+	else if (rc == 0)
+	    break;              /* EOF */
+	cnt = maxlen - 1 - n;
+	if (cnt > rp->rio_cnt)
+	    cnt = rp->rio_cnt;
+	if ((nl = memchr(rp->rio_bufptr, '\n', cnt)))
+	    cnt = nl - rp->rio_bufptr + 1;
+	memcpy(bufp + n, rp->rio_bufptr, cnt);
+	rp->rio_bufptr += cnt;
+	rp->rio_cnt -= cnt;
+	n += cnt;
+	if (nl)
+	    break;
+    }
+    bufp[n] = 0;
+    return n;
+}
+
+/*
+ * riox_readptrb - Zero-copy read for relays: return the number of
+ *    unread bytes in the buffer (refilling it with one read() if it is
+ *    empty) and point *ptrp at them. The bytes count as read and stay
+ *    valid until the next call. Returns 0 on EOF, -1 on error.
+ */
+ssize_t riox_readptrb(riox_t *rp, char **ptrp) 
+{
+    ssize_t n;
+
+    if ((n = riox_fill(rp)) <= 0)
+	return n;
+    *ptrp = rp->rio_bufptr;
+    rp->rio_bufptr += n;
+    rp->rio_cnt = 0;
+    return n;
+}
+
+/*
+ * riox_setbuf - Switch to buffer buf of size bytes (Malloc'd if buf is
+ *    NULL), carrying unread bytes over; used to grow or shrink a buffer
+ *    or to attach one to a parked riox_t. Returns -1 if the unread
+ *    bytes don't fit.
+ */
+int riox_setbuf(riox_t *rp, char *buf, size_t size) 
+{
+    int owned = (buf == NULL);
+
+    if ((size_t)rp->rio_cnt > size) {
+	errno = ENOBUFS;
+	return -1;
+    }
+    if (owned)
+	buf = Malloc(size);
+    if (rp->rio_cnt > 0)
+	memmove(buf, rp->rio_bufptr, rp->rio_cnt);
+    if (buf != rp->rio_buf) {
+	if (rp->rio_owned)
+	    Free(rp->rio_buf);
+	rp->rio_owned = owned;
+    }
+    rp->rio_buf = rp->rio_bufptr = buf;
+    rp->rio_bufsize = size;
+    return 0;
+}
+
+/*
+ * riox_park - Release the buffer while the descriptor is idle; a
+ *    Malloc'd buffer is freed, a caller-supplied one can be returned to
+ *    its owner. Attach a buffer with riox_setbuf before reading again.
+ *    Returns -1 (EBUSY) if there are unread bytes to lose.
+ */
+int riox_park(riox_t *rp) 
+{
+    if (rp->rio_cnt > 0) {
+	errno = EBUSY;
+	return -1;
+    }
+    if (rp->rio_owned)
+	Free(rp->rio_buf);
+    rp->rio_buf = rp->rio_bufptr = NULL;
+    rp->rio_bufsize = 0;
+    rp->rio_owned = 0;
+    return 0;
+}
+
+/*
+ * riox_free - Free the buffer if riox Malloc'd it
+ */
+void riox_free(riox_t *rp) 
+{
+    if (rp->rio_owned)
+	Free(rp->rio_buf);
+    rp->rio_buf = rp->rio_bufptr = NULL;
+    rp->rio_cnt = 0;
+    rp->rio_owned = 0;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -911,6 +1241,30 @@ void Rio_writen(int fd, void *usrbuf, size_t n)
 	unix_error("Rio_writen error");
 }
 
+void Rio_writev(int fd, struct iovec *iov, int iovcnt) 
+{
+    if (rio_writev(fd, iov, iovcnt) < 0)
+	unix_error("Rio_writev error");
+}
+
+void Rio_sendv(int fd, struct iovec *iov, int iovcnt, int flags) 
+{
+    if (rio_sendv(fd, iov, iovcnt, flags) < 0)
+	unix_error("Rio_sendv error");
+}
+
+void Rio_cork(int fd, int on) 
+{
+    if (rio_cork(fd, on) < 0)
+	unix_error("Rio_cork error");
+}
+
+void Rio_sendfile(int outfd, int infd, off_t *offset, size_t n) 
+{
+    if (rio_sendfile(outfd, infd, offset, n) < 0)
+	unix_error("Rio_sendfile error");
+}
+
 void Rio_readinitb(rio_t *rp, int fd)
 {
     rio_readinitb(rp, fd);
@@ -934,6 +1288,44 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+void Riox_readinitb(riox_t *rp, int fd, char *buf, size_t size)
+{
+    riox_readinitb(rp, fd, buf, size);
+}
+
+ssize_t Riox_readnb(riox_t *rp, void *usrbuf, size_t n) 
+{
+    ssize_t rc;
+
+    if ((rc = riox_readnb(rp, usrbuf, n)) < 0)
+	unix_error("Riox_readnb error");
+    return rc;
+}
+
+ssize_t Riox_readlineb(riox_t *rp, void *usrbuf, size_t maxlen) 
+{
+    ssize_t rc;
+
+    if ((rc = riox_readlineb(rp, usrbuf, maxlen)) < 0)
+	unix_error("Riox_readlineb error");
+    return rc;
+}
+
+ssize_t Riox_readptrb(riox_t *rp, char **ptrp) 
+{
+    ssize_t rc;
+
+    if ((rc = riox_readptrb(rp, ptrp)) < 0)
+	unix_error("Riox_readptrb error");
+    return rc;
+}
+
+void Riox_setbuf(riox_t *rp, char *buf, size_t size) 
+{
+    if (riox_setbuf(rp, buf, size) < 0)
+	unix_error("Riox_setbuf error");
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -986,15 +1378,10 @@ int open_clientfd(char *hostname, char *port) {
 /* $end open_clientfd */
 
 /*  
- * open_listenfd - Open and return a listening socket on port. This
- *     function is reentrant and protocol-independent.
- *
- *     On error, returns: 
- *       -2 for getaddrinfo error
- *       -1 with errno set for other errors.
+ * listenfd_on - open_listenfd and open_listenfd_reuseport: set
+ *     SO_REUSEPORT before binding if reuseport is nonzero
  */
-/* $begin open_listenfd */
-int open_listenfd(char *port) 
+static int listenfd_on(char *port, int reuseport) 
 {
     struct addrinfo hints, *listp, *p;
     int listenfd, rc, optval=1;
@@ -1019,6 +1406,14 @@ int open_listenfd(char *port)
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,    //line:netp:csapp:setsockopt
                    (const void *)&optval , sizeof(int));
 
+        /* Lets other sockets (with the option too) bind the same port */
+        if (reuseport &&
+            setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                       (const void *)&optval, sizeof(int)) < 0) {
+            close(listenfd);
+            continue;
+        }
+
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
             break; /* Success */
@@ -1041,8 +1436,34 @@ int open_listenfd(char *port)
     }
     return listenfd;
 }
+
+/*  
+ * open_listenfd - Open and return a listening socket on port. This
+ *     function is reentrant and protocol-independent.
+ *
+ *     On error, returns: 
+ *       -2 for getaddrinfo error
+ *       -1 with errno set for other errors.
+ */
+/* $begin open_listenfd */
+int open_listenfd(char *port) 
+{
+    return listenfd_on(port, 0);
+}
 /* $end open_listenfd */
 
+/*  
+ * open_listenfd_reuseport - Like open_listenfd, but with SO_REUSEPORT:
+ *     each call returns another socket listening on the same port,
+ *     and the kernel spreads new connections across them, so every
+ *     accepting thread can have its own socket instead of sharing one.
+ *     Errors are as for open_listenfd.
+ */
+int open_listenfd_reuseport(char *port) 
+{
+    return listenfd_on(port, 1);
+}
+
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
  ****************************************************/
@@ -1064,6 +1485,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_listenfd_reuseport(char *port) 
+{
+    int rc;
+
+    if ((rc = open_listenfd_reuseport(port)) < 0)
+	unix_error("Open_listenfd_reuseport error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
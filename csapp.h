@@ -25,8 +25,11 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
@@ -51,6 +54,18 @@ typedef struct {
 } rio_t;
 /* $end rio_t */
 
+/* Rio state whose buffer is supplied by the caller (or Malloc'd) and can
+ * be any size, swapped for another, or released while the descriptor
+ * is idle; see the Riox functions in csapp.c */
+typedef struct {
+    int rio_fd;                /* Descriptor for this internal buf */
+    int rio_cnt;               /* Unread bytes in internal buf */
+    char *rio_bufptr;          /* Next unread byte in internal buf */
+    char *rio_buf;             /* Internal buffer (NULL while parked) */
+    size_t rio_bufsize;        /* Size of rio_buf */
+    int rio_owned;             /* rio_buf was Malloc'd by riox_readinitb */
+} riox_t;
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -59,12 +74,15 @@ extern char **environ; /* Defined by libc */
 #define	MAXLINE	 8192  /* Max text line length */
 #define MAXBUF   8192  /* Max I/O buffer size */
 #define LISTENQ  1024  /* Second argument to listen() */
+#ifndef IOV_MAX
+#define IOV_MAX  UIO_MAXIOV /* Max iovecs per writev() call */
+#endif
 
 /* Our own error-handling functions */
 void unix_error(char *msg);
 void posix_error(int code, char *msg);
 void dns_error(char *msg);
-void gai_error(int code, char *msg);
+void eai_error(int code, char *msg); /* not gai_error: glibc declares that under _GNU_SOURCE */
 void app_error(char *msg);
 
 /* Process control wrappers */
@@ -167,6 +185,12 @@ void Pthread_exit(void *retval);
 pthread_t Pthread_self(void);
 void Pthread_once(pthread_once_t *once_control, void (*init_function)());
 
+/* Pthreads readers-writer lock wrappers */
+void Pthread_rwlock_init(pthread_rwlock_t *lock, const pthread_rwlockattr_t *attr);
+void Pthread_rwlock_rdlock(pthread_rwlock_t *lock);
+void Pthread_rwlock_wrlock(pthread_rwlock_t *lock);
+void Pthread_rwlock_unlock(pthread_rwlock_t *lock);
+
 /* POSIX semaphore wrappers */
 void Sem_init(sem_t *sem, int pshared, unsigned int value);
 void P(sem_t *sem);
@@ -175,24 +199,46 @@ void V(sem_t *sem);
 /* Rio (Robust I/O) package */
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
+ssize_t rio_sendv(int fd, struct iovec *iov, int iovcnt, int flags);
+int rio_cork(int fd, int on);
+ssize_t rio_sendfile(int outfd, int infd, off_t *offset, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+void riox_readinitb(riox_t *rp, int fd, char *buf, size_t size);
+ssize_t riox_readnb(riox_t *rp, void *usrbuf, size_t n);
+ssize_t riox_readlineb(riox_t *rp, void *usrbuf, size_t maxlen);
+ssize_t riox_readptrb(riox_t *rp, char **ptrp);
+int riox_setbuf(riox_t *rp, char *buf, size_t size);
+int riox_park(riox_t *rp);
+void riox_free(riox_t *rp);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
 void Rio_writen(int fd, void *usrbuf, size_t n);
+void Rio_writev(int fd, struct iovec *iov, int iovcnt);
+void Rio_sendv(int fd, struct iovec *iov, int iovcnt, int flags);
+void Rio_cork(int fd, int on);
+void Rio_sendfile(int outfd, int infd, off_t *offset, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+void Riox_readinitb(riox_t *rp, int fd, char *buf, size_t size);
+ssize_t Riox_readnb(riox_t *rp, void *usrbuf, size_t n);
+ssize_t Riox_readlineb(riox_t *rp, void *usrbuf, size_t maxlen);
+ssize_t Riox_readptrb(riox_t *rp, char **ptrp);
+void Riox_setbuf(riox_t *rp, char *buf, size_t size);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
 int open_listenfd(char *port);
+int open_listenfd_reuseport(char *port);
 
 /* Wrappers for reentrant protocol-independent client/server helpers */
 int Open_clientfd(char *hostname, char *port);
 int Open_listenfd(char *port);
+int Open_listenfd_reuseport(char *port);
 
 
 #endif /* __CSAPP_H__ */
@@ -4,80 +4,50 @@
  *             returns -1 on error, 0 otherwise.
  */
 #include "csapp.h"
+#include "phttp.h"
 #include <string.h>
 
 int parse_req(int connection, rio_t *rio, 
               char *host, char *port, char *path)  
 {  
   /* Parse request into method, uri, and version */
-  char meth[MAXLINE] = {0},
-       uri[MAXLINE]  = {0},          
-       vers[MAXLINE] = {0};   
+  struct phttp_request req;
   char rbuf[MAXLINE] = {0};
-  /* Strings to keep track of uri parsing */
-  char *spec, *check;           // port specified ?
-  char *buf, *p, *save; // used for explicit uri parse
-  /* Constants necessary for string lib functions */
-  const char colon[2] = ":";
-  const char bslash[2] = "/"; 
+  ssize_t rlen;
+  /* Slices of the uri */
+  slice h, p, pth;
 
   /* SETUP FOR PARSING -- */
   /* Initialize rio */
   Rio_readinitb(rio, connection); 
-  if (Rio_readlineb(rio, rbuf, MAXLINE) <= 0) {
+  if ((rlen = Rio_readlineb(rio, rbuf, MAXLINE)) <= 0) {
     bad_request(connection, rbuf);
-    flush_str(rbuf);
     return -1;
   } 
-  /* Splice the request */
-  sscanf(rbuf, "%s %s %s", meth, uri, vers);
-  flush_str(rbuf);  
+  /* Splice the request (tokens are slices of rbuf) */
+  if (phttp_parse_reqline(rbuf, rlen, &req) < 0) {
+    bad_request(connection, rbuf);
+    return -1;
+  }
   /* Error: HTTP request that isn't GET or 'http://' not found */
-  if (strcmp(meth, "GET") || !(strstr(uri, "http://"))) {                   
-    bad_request(connection, uri);
-    flush_strs(meth, uri, vers);
+  if (!phttp_slice_eq(req.method, "GET") ||
+      phttp_parse_uri(req.uri, &h, &p, &pth) < 0 ||
+      (p.len && memchr(p.ptr, ':', p.len))) { // cannot handle ':' after port
+    bad_request(connection, rbuf);
     return -1;
   } 
   /* PARSE URI */
   else {
-    buf = uri + 7; // ignore 'http://' 
-    spec = index(buf, ':'); 
-    check = rindex(buf, ':');
-    if (spec != check) return -1; // cannot handle ':' after port
-  /* Port is specified.. */
-    if (spec) {  
-    // Get host name
-      p = strtok_r(buf, colon, &save);
-      // Copy if successful
-      strcpy(host, p); 
-    // Get port from buf
-      buf = strtok_r(NULL, colon, &save);
-      p = strtok_r(buf, bslash, &save);
-      // Copy if successful
-      strcpy(port, p);
-    // Get path (rest of buf)
-      while ((p = strtok_r(NULL, bslash, &save)) != NULL) 
-      { strcat(path, bslash); strcat(path, p); }
-      if (is_dir(path)) 
-        strcat(path, bslash);
-    }
-  /* Port not specified.. */
-    else { 
-    // Get host name
-      p = strtok_r(buf, bslash, &save);  
-      strcpy(host, p);
-    // Get path
-      while ((p = strtok_r(NULL, bslash, &save)) != NULL) 
-      { strcat(path, bslash); strcat(path, p); } 
-      if (is_dir(path)) // append '/' if path is a directory
-        strcat(path, bslash);
-    // Set port as unspecified
-      strcpy(port, 80);
+  /* Host, port (80 if unspecified) and path (rest of uri) */
+    memcpy(host, h.ptr, h.len);
+    host[h.len] = '\0';
+    if (p.len) {
+      memcpy(port, p.ptr, p.len);
+      port[p.len] = '\0';
     }
-  /* Clean-up */
-    flush_strs(meth, uri, vers);
-    flush_strs(spec, buf, p);
-    flush_str(save);
+    else strcpy(port, "80");
+    memcpy(path, pth.ptr, pth.len);
+    path[pth.len] = '\0';
     return 0;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,187 @@
+/*
+ * pbuf.c
+ *
+ * Proxy Lab
+ *
+ * This is the pool of fixed-size I/O buffers the proxy's connections
+ * borrow while they have data to move and give back as soon as they
+ * are idle, so memory follows the number of active transfers rather
+ * than the number of open connections.
+ *
+ * Each thread keeps a few buffers in a thread-local cache, so the
+ * common get/put pair takes no lock. Only refilling an empty cache or
+ * spilling a full one touches the shared free list (under a mutex).
+ * Buffers are malloc'd lazily up to PBUF_MAX and, past PBUF_KEEP idle
+ * ones, handed back to malloc. Counters are updated with atomics.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "pbuf.h"
+
+/* A free buffer stores the free-list link in its own first bytes */
+struct pbuf_free {
+  struct pbuf_free *next;
+};
+
+/* Thread-local cache of buffers (lock-free fast path) */
+struct pbuf_tcache {
+  int cnt;
+  int registered; // destructor armed for this thread
+  char *bufs[PBUF_TCACHE];
+};
+static __thread struct pbuf_tcache tcache;
+
+/* Shared free list */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pbuf_free *free_list;
+static size_t free_cnt;
+
+/* Destructor key that flushes a thread's cache when the thread exits */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+/* Counters (see struct pbuf_stats) */
+static size_t allocated, in_use, high_water, gets, tcache_hits, exhausted;
+
+#define STAT_ADD(v, n) __atomic_add_fetch(&(v), (n), __ATOMIC_RELAXED)
+#define STAT_SUB(v, n) __atomic_sub_fetch(&(v), (n), __ATOMIC_RELAXED)
+#define STAT_GET(v)    __atomic_load_n(&(v), __ATOMIC_RELAXED)
+
+
+/*********************
+ * SHARED FREE LIST
+ *********************/
+
+/*
+ * release - put [buf] on the shared free list, or free it outright if
+ *           enough buffers are idle already; caller holds pool_lock
+ */
+static void release(char *buf)
+{
+  struct pbuf_free *node = (struct pbuf_free *)buf;
+
+  if (free_cnt >= PBUF_KEEP) {
+    free(buf);
+    STAT_SUB(allocated, 1);
+    return;
+  }
+  node->next = free_list;
+  free_list = node;
+  free_cnt++;
+}
+
+/*
+ * tcache_flush - hand every buffer in the calling thread's cache back
+ *                to the shared list (runs at thread exit)
+ */
+static void tcache_flush(void *arg)
+{
+  struct pbuf_tcache *tc = arg;
+
+  pthread_mutex_lock(&pool_lock);
+  while (tc->cnt > 0)
+    release(tc->bufs[--tc->cnt]);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+static void tcache_key_init(void)
+{
+  pthread_key_create(&tcache_key, tcache_flush);
+}
+
+
+/**********************
+ * POOL FUNCTIONS
+ **********************/
+
+/*
+ * pbuf_get - borrow a PBUF_SIZE buffer;
+ *            returns NULL if PBUF_MAX buffers are already borrowed
+ */
+char *pbuf_get(void)
+{
+  char *buf = NULL;
+  size_t n, hw;
+
+  /* Fast path: this thread's own cache */
+  if (tcache.cnt > 0) {
+    buf = tcache.bufs[--tcache.cnt];
+    STAT_ADD(tcache_hits, 1);
+  }
+  else {
+    pthread_mutex_lock(&pool_lock);
+    if (free_list) {
+      buf = (char *)free_list;
+      free_list = free_list->next;
+      free_cnt--;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    /* Nothing free: grow the pool unless it's at its limit */
+    if (!buf) {
+      if (STAT_ADD(allocated, 1) > PBUF_MAX) {
+        STAT_SUB(allocated, 1);
+        STAT_ADD(exhausted, 1);
+        return NULL;
+      }
+      if (!(buf = malloc(PBUF_SIZE))) {
+        STAT_SUB(allocated, 1);
+        STAT_ADD(exhausted, 1);
+        return NULL;
+      }
+    }
+  }
+
+  STAT_ADD(gets, 1);
+  n = STAT_ADD(in_use, 1);
+  hw = STAT_GET(high_water);
+  while (n > hw && !__atomic_compare_exchange_n(&high_water, &hw, n, 0,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED))
+    ;
+  return buf;
+}
+
+/*
+ * pbuf_put - give back a buffer [buf] borrowed with pbuf_get
+ */
+void pbuf_put(char *buf)
+{
+  if (!buf)
+    return;
+  STAT_SUB(in_use, 1);
+
+  /* Fast path: keep it in this thread's cache */
+  if (tcache.cnt < PBUF_TCACHE) {
+    if (!tcache.registered) {
+      pthread_once(&tcache_once, tcache_key_init);
+      pthread_setspecific(tcache_key, &tcache);
+      tcache.registered = 1;
+    }
+    tcache.bufs[tcache.cnt++] = buf;
+    return;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  release(buf);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+
+/*********************
+ * METRICS FUNCTIONS
+ *********************/
+
+/*
+ * pbuf_stats - fill in [st] with the current pool counters
+ */
+void pbuf_stats(struct pbuf_stats *st)
+{
+  st->allocated   = STAT_GET(allocated);
+  st->in_use      = STAT_GET(in_use);
+  st->high_water  = STAT_GET(high_water);
+  st->gets        = STAT_GET(gets);
+  st->tcache_hits = STAT_GET(tcache_hits);
+  st->exhausted   = STAT_GET(exhausted);
+}
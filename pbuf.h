@@ -0,0 +1,38 @@
+/*
+ * pbuf.h
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pbuf.c (shared I/O buffer pool for proxy)
+ */
+#ifndef __PBUF_H__
+#define __PBUF_H__
+
+#include <stddef.h>
+
+/* Every pool buffer is this big (request headers and relay chunks) */
+#define PBUF_SIZE (64 * 1024) // 64 Kb
+/* Most buffers the pool will hand out at once (4096 x 64 Kb = 256 Mb) */
+#define PBUF_MAX 4096
+/* Buffers a thread keeps for itself before giving them back */
+#define PBUF_TCACHE 4
+/* Free buffers kept in the shared list; the rest go back to malloc */
+#define PBUF_KEEP 64
+
+/* Snapshot of pool counters, filled in by pbuf_stats */
+struct pbuf_stats {
+  size_t allocated;  // buffers that exist (in use + cached + free)
+  size_t in_use;     // buffers currently borrowed
+  size_t high_water; // most buffers ever borrowed at once
+  size_t gets;       // successful pbuf_get calls
+  size_t tcache_hits;// ... served from the calling thread's cache
+  size_t exhausted;  // pbuf_get calls refused because PBUF_MAX was hit
+};
+
+/* Function prototypes for the buffer pool */
+char *pbuf_get(void);
+void pbuf_put(char *buf);
+/* Function prototypes for pool metrics */
+void pbuf_stats(struct pbuf_stats *st);
+
+#endif
@@ -12,6 +12,7 @@
 
 #include "csapp.h"
 #include "pcache.h"
+#include "pprobe.h"
 
 
 /*****************
@@ -84,7 +85,10 @@ line *in_cache(cache *cash, char *host, char *path)
 
   /* CRITICAL SECTION: READING */ 
   /* Nothing is in the cache if it's empty */
-  if (cash->size == 0) return NULL;
+  if (cash->size == 0) {
+    PPROBE2(cache__miss, host, path);
+    return NULL;
+  }
   /* Incr. age of lines */
   age_lines(cash);
   /* Create the location given host and path */
@@ -98,12 +102,17 @@ line *in_cache(cache *cash, char *host, char *path)
   {
     if (!strcmp(loc, lion->loc)) {
       object = lion;
+      __atomic_store_n(&lion->age, 0, __ATOMIC_RELAXED); // Used just now (LRU)
       break; // Object found!
     }
     lion = lion->next;
   }
   /* END CRITICAL SECTION */
 
+  if (object)
+    PPROBE3(cache__hit, host, path, object->size);
+  else
+    PPROBE2(cache__miss, host, path);
   return object; 
 }
 
@@ -155,33 +164,43 @@ line *make_line(char *host, char *path, char *object, size_t obj_size)
 }
 
 /* 
- * add_line - add a line [lion] to the cache and evict if necessary
+ * add_line - add a line [lion] to the cache and evict if necessary;
+ *            returns the number of lines evicted
  *
  * Note: must call make_line before adding a line
  */
-void add_line(cache *cash, line *lion) 
+int add_line(cache *cash, line *lion) 
 {
+  int evicted = 0;
+  line *evict;
+
   /* CRITICAL SECTION: WRITE */
-  /* If the cache is full, choose a line to evict & remove it */
-  if (cache_full(cash))
-    remove_line(cash, choose_evict(cash));
+  /* While the cache is full, choose a line to evict & remove it */
+  while (cache_full(cash) && cash->start) {
+    evict = choose_evict(cash);
+    PPROBE2(cache__evict, evict->loc, evict->size);
+    remove_line(cash, evict);
+    evicted++;
+  }
   /* Insert the line at the beginning of the list */
   lion->next = cash->start;
   cash->start = lion;
   /* Update the cache size accordingly */
   cash->size += lion->size;
   /* END CRITICAL SECTION */
+  return evicted;
 }
 
 /*
- * age_lines - age the cache (for LRU policy)
+ * age_lines - age the cache (for LRU policy); atomic because lookups
+ *             age lines while holding only the read lock
  */
 void age_lines(cache *cash)   
 {
   line *lion = cash->start;
   /* Increment age of all lines */
   while (lion != NULL) 
-  { (lion->age)++; lion = lion->next; }
+  { __atomic_add_fetch(&lion->age, 1, __ATOMIC_RELAXED); lion = lion->next; }
 }
 
 /*
@@ -224,13 +243,13 @@ void remove_line(cache *cash, line *lion)
 line *choose_evict(cache *cash)          
 {
   line *evict, *lion;
-  int eldest = -1;
+  unsigned int eldest = 0;
 
   lion = cash->start;
   evict = lion;
-  /* Search the cache for the oldest line */
+  /* Search the cache for the oldest line (ties go to the one added first) */
   while (lion != NULL) {
-    if (lion->age > eldest) {
+    if (lion->age >= eldest) {
       eldest = lion->age;
       evict = lion;
     }
@@ -252,6 +271,96 @@ void free_line(cache *cash, line *lion)
 }
 
 
+/**************************
+ * CACHE SNAPSHOT FUNCTIONS
+ **************************/
+
+/*
+ * A snapshot is a stream of records, one per line in list order:
+ * three uint32s (length of loc, size of obj, age), then loc (no
+ * terminating NUL) and obj; a record with a zero loc length ends it.
+ * Only a proxy built from the same sources reads it, so it is in host
+ * byte order.
+ */
+
+/*
+ * cache_save - write every line of cache [cash] to [fd] as a snapshot;
+ *              caller holds the read lock;
+ *              returns the number of lines written, -1 on a write error
+ */
+int cache_save(cache *cash, int fd)
+{
+  uint32_t rec[3];
+  line *lion;
+  int n = 0;
+
+  for (lion = cash->start; lion != NULL; lion = lion->next, n++) {
+    rec[0] = strlen(lion->loc);
+    rec[1] = lion->size;
+    rec[2] = lion->age;
+    if (rio_writen(fd, rec, sizeof(rec)) < 0 ||
+        rio_writen(fd, lion->loc, rec[0]) < 0 ||
+        rio_writen(fd, lion->obj, rec[1]) < 0)
+      return -1;
+  }
+  rec[0] = rec[1] = rec[2] = 0;
+  if (rio_writen(fd, rec, sizeof(rec)) < 0)
+    return -1;
+  return n;
+}
+
+/*
+ * cache_load - append the lines of a snapshot read from [fd] to cache
+ *              [cash], keeping their order and ages (lines that would
+ *              overflow MAX_CACHE_SIZE are skipped); caller holds the
+ *              write lock, or no other thread uses the cache yet;
+ *              returns the number of lines added, -1 if the snapshot
+ *              was cut short or malformed (the lines before stay)
+ */
+int cache_load(cache *cash, int fd)
+{
+  rio_t rio;
+  uint32_t rec[3];
+  line *lion, **tail = &cash->start;
+  int n = 0;
+
+  while (*tail != NULL)
+    tail = &(*tail)->next;
+  rio_readinitb(&rio, fd);
+  while (1) {
+    if (rio_readnb(&rio, rec, sizeof(rec)) != sizeof(rec) || rec[0] > MAXLINE * 2 ||
+        rec[1] > MAX_OBJECT_SIZE)
+      return -1;
+    if (rec[0] == 0) // End of snapshot
+      return n;
+    lion = Malloc(sizeof(struct cache_line));
+    lion->loc = Malloc(rec[0] + 1);
+    lion->obj = Malloc(rec[1] + 1);
+    if (rio_readnb(&rio, lion->loc, rec[0]) != rec[0] ||
+        rio_readnb(&rio, lion->obj, rec[1]) != rec[1]) {
+      Free(lion->loc);
+      Free(lion->obj);
+      Free(lion);
+      return -1;
+    }
+    if (cash->size + rec[1] > MAX_CACHE_SIZE) { // Doesn't fit
+      Free(lion->loc);
+      Free(lion->obj);
+      Free(lion);
+      continue;
+    }
+    lion->loc[rec[0]] = '\0';
+    lion->size = rec[1];
+    lion->age = rec[2];
+    lion->next = NULL;
+    *tail = lion;
+    tail = &lion->next;
+    cash->size += lion->size;
+    n++;
+  }
+}
+
+
 /*********************
  * DEBUGGING FUNCTIONS
  *********************/
@@ -315,7 +424,7 @@ void print_line(line *lion)
     if (strlen(location)) printf("| %s ", location);
     else printf("| EMPTY LOC ");
     // Object
-    if (strlen(object))   printf("| . . . ", object);
+    if (strlen(object))   printf("| . . . ");
     else printf("| EMPTY OBJ ");
     // Age
     printf("| age=%u ] ", age);
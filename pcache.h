@@ -47,11 +47,14 @@ void cache_free(cache *cash);
 /* Function prototypes for cache_line operations */
 line *in_cache(cache *cash, char *host, char *path);
 line *make_line(char *host, char *path, char *object, size_t obj_size);
-void add_line(cache *cash, line *lion);
+int add_line(cache *cash, line *lion);
 void remove_line(cache *cash, line *lion);
 line *choose_evict(cache *cash);
 void free_line(cache *cash, line *lion);;
 void age_lines(cache *cash);
+/* Function prototypes for cache snapshots (hot restart) */
+int cache_save(cache *cash, int fd);
+int cache_load(cache *cash, int fd);
 /* Function prototypes for debugging */
 void cache_error(char *msg);
 void print_cache(cache *cash);
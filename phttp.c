@@ -0,0 +1,573 @@
+/*
+ * phttp.c
+ *
+ * Proxy Lab
+ *
+ * This is the HTTP tokenizer used by the proxy. It splits a request
+ * line (or a response's status line) and header block into slices of
+ * the caller's buffer without copying, and parses Range values (for
+ * tiny too). The byte scanning (looking for SP, ':' and CRLF) is done
+ * 16 or 32 bytes at a time with SSE4.2 or AVX2 when the CPU supports
+ * it, with a plain scalar loop as the fallback; the scanner is picked
+ * once at startup.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "phttp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PHTTP_X86 1
+#include <immintrin.h>
+#endif
+
+
+/******************
+ * SCALAR SCANNERS
+ ******************/
+
+/*
+ * scan_token_scalar - return a pointer to the first byte in [p, end) that
+ *                     ends a token: a control char, SP, DEL or [delim];
+ *                     returns end if there is none
+ */
+static const char *scan_token_scalar(const char *p, const char *end, char delim)
+{
+  for (; p < end; p++) {
+    unsigned char c = (unsigned char)*p;
+    if (c <= ' ' || c == 0x7f || c == (unsigned char)delim)
+      break;
+  }
+  return p;
+}
+
+/*
+ * scan_value_scalar - return a pointer to the first byte in [p, end) that
+ *                     ends a header value: a control char other than
+ *                     HTAB (i.e. CR or LF) or DEL; returns end if none
+ */
+static const char *scan_value_scalar(const char *p, const char *end)
+{
+  for (; p < end; p++) {
+    unsigned char c = (unsigned char)*p;
+    if ((c < ' ' && c != '\t') || c == 0x7f)
+      break;
+  }
+  return p;
+}
+
+
+/****************
+ * SIMD SCANNERS
+ ****************/
+#ifdef PHTTP_X86
+
+/*
+ * scan_token_sse42 - scan_token using PCMPESTRI range matching
+ */
+__attribute__((target("sse4.2")))
+static const char *scan_token_sse42(const char *p, const char *end, char delim)
+{
+  /* Ranges: [0x00-0x20], [0x7f-0x7f], [delim-delim] */
+  const char ranges[16] = { 0x00, ' ', 0x7f, 0x7f, delim, delim };
+  const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int i = _mm_cmpestri(r, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                      _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16)
+      return p + i;
+    p += 16;
+  }
+  return scan_token_scalar(p, end, delim);
+}
+
+/*
+ * scan_value_sse42 - scan_value using PCMPESTRI range matching
+ */
+__attribute__((target("sse4.2")))
+static const char *scan_value_sse42(const char *p, const char *end)
+{
+  /* Ranges: [0x00-0x08], [0x0a-0x1f], [0x7f-0x7f] */
+  static const char ranges[16] = { 0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f };
+  const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int i = _mm_cmpestri(r, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                      _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16)
+      return p + i;
+    p += 16;
+  }
+  return scan_value_scalar(p, end);
+}
+
+/*
+ * scan_token_avx2 - scan_token over 32 bytes per step; v <= 0x20 is
+ *                   tested as min(v, 0x20) == v since AVX2 has no
+ *                   unsigned byte compare
+ */
+__attribute__((target("avx2")))
+static const char *scan_token_avx2(const char *p, const char *end, char delim)
+{
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i d = _mm256_set1_epi8(delim);
+
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(v, sp), v);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, del));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, d));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return scan_token_scalar(p, end, delim);
+}
+
+/*
+ * scan_value_avx2 - scan_value over 32 bytes per step
+ */
+__attribute__((target("avx2")))
+static const char *scan_value_avx2(const char *p, const char *end)
+{
+  const __m256i us = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, us), v);
+    __m256i m = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, del));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return scan_value_scalar(p, end);
+}
+
+#endif /* PHTTP_X86 */
+
+
+/*******************
+ * SCANNER DISPATCH
+ *******************/
+
+/* A scanner is a named pair of token/value scan functions */
+struct phttp_scanner {
+  const char *name;
+  const char *(*token)(const char *p, const char *end, char delim);
+  const char *(*value)(const char *p, const char *end);
+};
+
+static const struct phttp_scanner scanners[] = {
+  { "scalar", scan_token_scalar, scan_value_scalar },
+#ifdef PHTTP_X86
+  { "sse4.2", scan_token_sse42, scan_value_sse42 },
+  { "avx2",   scan_token_avx2,  scan_value_avx2 },
+#endif
+};
+#define NUM_SCANNERS (sizeof(scanners) / sizeof(scanners[0]))
+
+/* Scanner in use; scalar until phttp_init runs */
+static const struct phttp_scanner *scan = &scanners[0];
+
+/*
+ * scanner_supported - determines if the CPU can run scanner [s];
+ *                     returns 1 if it can, 0 if not
+ */
+static int scanner_supported(const struct phttp_scanner *s)
+{
+#ifdef PHTTP_X86
+  __builtin_cpu_init();
+  if (!strcmp(s->name, "sse4.2"))
+    return __builtin_cpu_supports("sse4.2");
+  if (!strcmp(s->name, "avx2"))
+    return __builtin_cpu_supports("avx2");
+#endif
+  return 1;
+}
+
+/*
+ * phttp_init - pick the widest scanner the CPU supports (runs before main)
+ */
+__attribute__((constructor))
+static void phttp_init(void)
+{
+  int i;
+
+  for (i = NUM_SCANNERS - 1; i > 0; i--)
+    if (scanner_supported(&scanners[i]))
+      break;
+  scan = &scanners[i];
+}
+
+/*
+ * phttp_impl - returns the name of the scanner in use
+ */
+const char *phttp_impl(void)
+{
+  return scan->name;
+}
+
+/*
+ * phttp_select - force the scanner named [name] (for benchmarks);
+ *                returns 0 on success, -1 if unknown or unsupported
+ */
+int phttp_select(const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < NUM_SCANNERS; i++) {
+    if (!strcmp(scanners[i].name, name)) {
+      if (!scanner_supported(&scanners[i]))
+        return -1;
+      scan = &scanners[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+
+/*****************
+ * TOKENIZER
+ *****************/
+
+/*
+ * parse_eol - consume a CRLF (or bare LF) at [p];
+ *             returns pointer past it, NULL if incomplete, or
+ *             sets *err if something else is there
+ */
+static const char *parse_eol(const char *p, const char *end, int *err)
+{
+  if (p == end)
+    return NULL;
+  if (*p == '\r') {
+    if (++p == end)
+      return NULL;
+  }
+  if (*p != '\n') {
+    *err = 1;
+    return NULL;
+  }
+  return p + 1;
+}
+
+/*
+ * phttp_parse_reqline - tokenize the request line at the start of [buf]
+ *                       into method, uri and version;
+ *                       returns bytes consumed (incl. CRLF), PHTTP_ERROR
+ *                       or PHTTP_INCOMPLETE
+ */
+int phttp_parse_reqline(const char *buf, size_t len, struct phttp_request *req)
+{
+  const char *p = buf, *end = buf + len, *q;
+  int err = 0;
+
+  /* Method and URI are SP-terminated tokens */
+  q = scan->token(p, end, ' ');
+  if (q == end) return PHTTP_INCOMPLETE;
+  if (*q != ' ' || q == p) return PHTTP_ERROR;
+  req->method.ptr = p;
+  req->method.len = q - p;
+  p = q + 1;
+
+  q = scan->token(p, end, ' ');
+  if (q == end) return PHTTP_INCOMPLETE;
+  if (*q != ' ' || q == p) return PHTTP_ERROR;
+  req->uri.ptr = p;
+  req->uri.len = q - p;
+  p = q + 1;
+
+  /* Version runs to the end of the line */
+  q = scan->token(p, end, ' ');
+  if (q == end) return PHTTP_INCOMPLETE;
+  if ((*q != '\r' && *q != '\n') || q == p) return PHTTP_ERROR;
+  req->version.ptr = p;
+  req->version.len = q - p;
+
+  if (!(p = parse_eol(q, end, &err)))
+    return err ? PHTTP_ERROR : PHTTP_INCOMPLETE;
+  return (int)(p - buf);
+}
+
+/*
+ * parse_headers - tokenize header lines from [p] up to and including the
+ *                 empty line into [headers]; returns pointer past the
+ *                 empty line, or NULL with *err = PHTTP_ERROR or
+ *                 PHTTP_INCOMPLETE
+ */
+static const char *parse_headers(const char *p, const char *end,
+                                 struct phttp_header *headers, int *num,
+                                 int *err)
+{
+  const char *q;
+  struct phttp_header *h;
+  int bad = 0;
+
+  *num = 0;
+  *err = PHTTP_INCOMPLETE;
+  while (1) {
+    if (p == end)
+      return NULL;
+    /* Empty line ends the header block */
+    if (*p == '\r' || *p == '\n') {
+      if (!(p = parse_eol(p, end, &bad)) && bad)
+        *err = PHTTP_ERROR;
+      return p;
+    }
+    if (*num == PHTTP_MAX_HEADERS) {
+      *err = PHTTP_ERROR;
+      return NULL;
+    }
+    h = &headers[*num];
+
+    /* Name is a token ended by ':' */
+    q = scan->token(p, end, ':');
+    if (q == end) return NULL;
+    if (*q != ':' || q == p) {
+      *err = PHTTP_ERROR;
+      return NULL;
+    }
+    h->name.ptr = p;
+    h->name.len = q - p;
+
+    /* Value is everything up to CRLF, minus surrounding whitespace */
+    for (p = q + 1; p < end && (*p == ' ' || *p == '\t'); p++)
+      ;
+    q = scan->value(p, end);
+    if (q == end) return NULL;
+    h->value.ptr = p;
+    h->value.len = q - p;
+    while (h->value.len &&
+           (p[h->value.len - 1] == ' ' || p[h->value.len - 1] == '\t'))
+      h->value.len--;
+
+    if (!(p = parse_eol(q, end, &bad))) {
+      if (bad)
+        *err = PHTTP_ERROR;
+      return NULL;
+    }
+    (*num)++;
+  }
+}
+
+/*
+ * phttp_parse_request - tokenize a request line and the header block
+ *                       that follows it, up to and including the empty
+ *                       line; returns bytes consumed, PHTTP_ERROR or
+ *                       PHTTP_INCOMPLETE (read more and call again)
+ */
+int phttp_parse_request(const char *buf, size_t len, struct phttp_request *req)
+{
+  const char *p;
+  int rc, err;
+
+  req->num_headers = 0;
+  if ((rc = phttp_parse_reqline(buf, len, req)) < 0)
+    return rc;
+  if (!(p = parse_headers(buf + rc, buf + len, req->headers,
+                          &req->num_headers, &err)))
+    return err;
+  return (int)(p - buf);
+}
+
+/*
+ * phttp_parse_response - tokenize a status line (HTTP/x.y NNN reason)
+ *                        and the header block that follows it; returns
+ *                        bytes consumed (where the body starts),
+ *                        PHTTP_ERROR or PHTTP_INCOMPLETE
+ */
+int phttp_parse_response(const char *buf, size_t len, struct phttp_response *resp)
+{
+  const char *p = buf, *end = buf + len, *q;
+  int i, err = 0;
+
+  resp->num_headers = 0;
+
+  /* Version is a SP-terminated token */
+  q = scan->token(p, end, ' ');
+  if (q == end) return PHTTP_INCOMPLETE;
+  if (*q != ' ' || q - p < 5 || strncmp(p, "HTTP/", 5)) return PHTTP_ERROR;
+  resp->version.ptr = p;
+  resp->version.len = q - p;
+  p = q + 1;
+
+  /* Status is exactly three digits */
+  if (end - p < 4) return PHTTP_INCOMPLETE;
+  resp->status = 0;
+  for (i = 0; i < 3; i++) {
+    if (p[i] < '0' || p[i] > '9') return PHTTP_ERROR;
+    resp->status = resp->status * 10 + (p[i] - '0');
+  }
+  p += 3;
+
+  /* Reason (possibly empty, may contain spaces) runs to the end of the line */
+  if (*p == ' ')
+    p++;
+  q = scan->value(p, end);
+  if (q == end) return PHTTP_INCOMPLETE;
+  resp->reason.ptr = p;
+  resp->reason.len = q - p;
+  if (!(p = parse_eol(q, end, &err)))
+    return err ? PHTTP_ERROR : PHTTP_INCOMPLETE;
+
+  if (!(p = parse_headers(p, end, resp->headers, &resp->num_headers, &err)))
+    return err;
+  return (int)(p - buf);
+}
+
+/*
+ * phttp_parse_uri - split an absolute URI (http://host[:port][/path])
+ *                   into host, port and path; port is empty and path
+ *                   is "/" when the URI leaves them out;
+ *                   returns 0 on success, PHTTP_ERROR otherwise
+ */
+int phttp_parse_uri(slice uri, slice *host, slice *port, slice *path)
+{
+  const char *p = uri.ptr, *end = uri.ptr + uri.len, *slash, *colon;
+
+  if (uri.len < 7 || strncasecmp(p, "http://", 7))
+    return PHTTP_ERROR;
+  p += 7;
+
+  /* Host runs to the first '/' (or the end); port follows a ':' in it */
+  if (!(slash = memchr(p, '/', end - p)))
+    slash = end;
+  if ((colon = memchr(p, ':', slash - p))) {
+    host->ptr = p;
+    host->len = colon - p;
+    port->ptr = colon + 1;
+    port->len = slash - (colon + 1);
+  }
+  else {
+    host->ptr = p;
+    host->len = slash - p;
+    port->ptr = slash;
+    port->len = 0;
+  }
+  if (host->len == 0)
+    return PHTTP_ERROR;
+
+  if (slash == end) {
+    path->ptr = "/";
+    path->len = 1;
+  }
+  else {
+    path->ptr = slash;
+    path->len = end - slash;
+  }
+  return 0;
+}
+
+/*
+ * parse_size - parse the decimal digits at [p, end) into [*val],
+ *              saturating at SIZE_MAX (past the end of anything) instead
+ *              of wrapping around; returns a pointer past the digits
+ */
+static const char *parse_size(const char *p, const char *end, size_t *val)
+{
+  size_t v = 0;
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    v = v > (SIZE_MAX - 9) / 10 ? SIZE_MAX : v * 10 + (*p - '0');
+  *val = v;
+  return p;
+}
+
+/*
+ * phttp_parse_range - parse a Range header value ("bytes=0-99,200-,-50")
+ *                     against a representation of [size] bytes into at
+ *                     most [max] ranges, clamped to the size (a position
+ *                     too big to represent is past the end);
+ *                     returns how many are satisfiable (0 means none:
+ *                     416), or PHTTP_ERROR if the value is malformed or
+ *                     asks for too many ranges (ignore it, send it all)
+ */
+int phttp_parse_range(slice value, size_t size, struct phttp_range *ranges, int max)
+{
+  const char *p = value.ptr, *end = value.ptr + value.len;
+  size_t first, last;
+  int n = 0, parts = 0, has_last;
+
+  if (value.len < 6 || strncasecmp(p, "bytes=", 6))
+    return PHTTP_ERROR;
+  p += 6;
+
+  while (1) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    if (p < end && *p == '-') {
+      /* -N: the last N bytes */
+      if (++p == end || *p < '0' || *p > '9')
+        return PHTTP_ERROR;
+      p = parse_size(p, end, &last);
+      first = last < size ? size - last : 0;
+      has_last = (last > 0);
+      last = size - 1;
+      if (!has_last)
+        first = size; // "-0" matches nothing
+    }
+    else {
+      /* N- or N-M */
+      if (p == end || *p < '0' || *p > '9')
+        return PHTTP_ERROR;
+      p = parse_size(p, end, &first);
+      if (p == end || *p++ != '-')
+        return PHTTP_ERROR;
+      has_last = (p < end && *p >= '0' && *p <= '9');
+      p = parse_size(p, end, &last);
+      if (has_last && last < first)
+        return PHTTP_ERROR;
+      if (!has_last || last >= size)
+        last = size - 1;
+    }
+    if (++parts > max)
+      return PHTTP_ERROR;
+    if (first < size) { // ranges starting past the end are skipped
+      ranges[n].first = first;
+      ranges[n].last = last;
+      n++;
+    }
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    if (p == end)
+      return n;
+    if (*p++ != ',')
+      return PHTTP_ERROR;
+  }
+}
+
+/*
+ * phttp_find_header - find the first header named [name] (case-
+ *                     insensitive); returns its value, or NULL
+ */
+slice *phttp_find_header(struct phttp_header *headers, int num_headers, const char *name)
+{
+  int i;
+
+  for (i = 0; i < num_headers; i++)
+    if (phttp_slice_eq(headers[i].name, name))
+      return &headers[i].value;
+  return NULL;
+}
+
+/*
+ * phttp_slice_eq - compare slice [s] with [str] case-insensitively
+ *                  (header names); returns 1 if equal, 0 if not
+ */
+int phttp_slice_eq(slice s, const char *str)
+{
+  size_t n = strlen(str);
+
+  return s.len == n && !strncasecmp(s.ptr, str, n);
+}
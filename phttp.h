@@ -0,0 +1,74 @@
+/*
+ * phttp.h
+ *
+ * Proxy Lab
+ *
+ * This is the header file for phttp.c (HTTP request/response tokenizer
+ * for proxy)
+ */
+#ifndef __PHTTP_H__
+#define __PHTTP_H__
+
+#include <stddef.h>
+
+/* Most headers a single request may carry */
+#define PHTTP_MAX_HEADERS 64
+/* Most byte ranges honored in one Range header */
+#define PHTTP_MAX_RANGES 16
+
+/* Return codes of the parse functions (>= 0 is bytes consumed) */
+#define PHTTP_ERROR      -1
+#define PHTTP_INCOMPLETE -2
+
+/* A slice is a view into the caller's request buffer; it is NOT
+ * nul-terminated and is only valid as long as that buffer is.
+ */
+struct phttp_slice {
+  const char *ptr;
+  size_t len;
+};
+typedef struct phttp_slice slice;
+
+/* A header is a name/value pair of slices (value is trimmed) */
+struct phttp_header {
+  slice name;
+  slice value;
+};
+
+/* Tokenized request: request line plus up to PHTTP_MAX_HEADERS headers */
+struct phttp_request {
+  slice method;
+  slice uri;
+  slice version;
+  int num_headers;
+  struct phttp_header headers[PHTTP_MAX_HEADERS];
+};
+
+/* Tokenized response: status line plus up to PHTTP_MAX_HEADERS headers */
+struct phttp_response {
+  slice version;
+  int status;
+  slice reason;
+  int num_headers;
+  struct phttp_header headers[PHTTP_MAX_HEADERS];
+};
+
+/* One byte range [first, last] (inclusive) of a representation */
+struct phttp_range {
+  size_t first;
+  size_t last;
+};
+
+/* Function prototypes for tokenizing */
+int phttp_parse_reqline(const char *buf, size_t len, struct phttp_request *req);
+int phttp_parse_request(const char *buf, size_t len, struct phttp_request *req);
+int phttp_parse_response(const char *buf, size_t len, struct phttp_response *resp);
+int phttp_parse_uri(slice uri, slice *host, slice *port, slice *path);
+int phttp_parse_range(slice value, size_t size, struct phttp_range *ranges, int max);
+slice *phttp_find_header(struct phttp_header *headers, int num_headers, const char *name);
+int phttp_slice_eq(slice s, const char *str);
+/* Function prototypes for scanner selection */
+const char *phttp_impl(void);
+int phttp_select(const char *name);
+
+#endif
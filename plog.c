@@ -0,0 +1,376 @@
+/*
+ * plog.c
+ *
+ * Proxy Lab
+ *
+ * This is the proxy's access log: one line per request with its
+ * client, URL, status, bytes, cache outcome and duration, written by a
+ * background thread so that no request waits on stdio's lock or on
+ * the terminal, pipe or disk behind it.
+ *
+ * Every thread that logs owns a single-producer ring of entries. The
+ * thread copies its entry into the next free slot and publishes it by
+ * advancing the ring's tail; the writer thread drains each ring from
+ * its head, formats the entries and writes them out through one
+ * buffered FILE, flushing whenever it runs out of work. Neither side
+ * takes a lock. Rings are malloc'd the first time more threads log at
+ * once than there are rings (under a mutex, at most PLOG_RINGS times)
+ * and are released for reuse when their thread exits. An entry that
+ * finds its ring full, or no ring free, is dropped and counted rather
+ * than blocking the request.
+ *
+ * With sampling, each request is logged with probability 1/sample
+ * (decided per thread, so threads share no counter).
+ *
+ * Each line carries the request's phases (see enum plog_mark). The
+ * PLOG_SLOWEST slowest requests, sampled or not, are also kept aside:
+ * a request only takes the lock that guards them if it is slower than
+ * the fastest of those, which is rare once the list has filled. On
+ * SIGUSR1 the writer writes them out, slowest first, and starts a new
+ * list. SIGUSR1 is blocked in every thread but the writer, which waits
+ * for it with sigtimedwait, so no request's system call is interrupted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <netdb.h>
+#include "plog.h"
+
+/* One thread's queue of entries; head and tail on their own lines */
+struct plog_ring {
+  unsigned head __attribute__((aligned(64)));  // next entry the writer reads
+  unsigned tail __attribute__((aligned(64)));  // next entry the owner fills
+  int owned __attribute__((aligned(64)));      // a live thread writes here
+  struct plog_entry entries[PLOG_RING];
+};
+
+static struct plog_ring *rings[PLOG_RINGS];
+static unsigned nrings;                        // rings[0..nrings) exist
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct plog_ring *my_ring;
+static __thread unsigned my_seed;
+static unsigned next_seed = 2463534242u;
+
+/* Destructor key that gives a thread's ring back when the thread exits */
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static FILE *log_fp;
+static unsigned log_sample;                   // 0: off, n: 1 request in n
+static size_t dropped;
+static int flush_wanted;                      // plog_close waits for this to clear
+
+/* Slowest requests since the last dump, and the least slow of them once full */
+static struct plog_entry slowest[PLOG_SLOWEST];
+static int nslowest;
+static uint64_t slow_floor;
+static pthread_mutex_t slowest_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *cache_names[] = {"-", "hit", "miss"};
+/* Logged name of the phase that ends at each mark */
+static const char *phase_names[PLOG_NMARKS] = {
+  NULL, "read", "cache", "dns", "connect", "send", "wait", "xfer"};
+
+#define DURATION(e) ((e)->mark[PLOG_END] - (e)->mark[PLOG_START])
+
+
+/***********
+ * RINGS
+ ***********/
+
+static void release_ring(void *arg)
+{
+  struct plog_ring *r = arg;
+
+  __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void make_key(void)
+{
+  pthread_key_create(&ring_key, release_ring);
+}
+
+/*
+ * ring - the calling thread's ring: a released one if any, else a new
+ *        one; NULL if PLOG_RINGS threads hold one already
+ */
+static struct plog_ring *ring(void)
+{
+  struct plog_ring *r = NULL;
+  unsigned i, n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+  int zero;
+
+  if (my_ring)
+    return my_ring;
+  for (i = 0; i < n && !r; i++) {
+    zero = 0;
+    if (!__atomic_load_n(&rings[i]->owned, __ATOMIC_RELAXED) &&
+        __atomic_compare_exchange_n(&rings[i]->owned, &zero, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      r = rings[i];
+  }
+  if (!r) {
+    pthread_mutex_lock(&rings_lock);
+    if (nrings < PLOG_RINGS && !posix_memalign((void **)&r, 64, sizeof(*r))) {
+      memset(r, 0, sizeof(*r));
+      r->owned = 1;
+      rings[nrings] = r;
+      __atomic_store_n(&nrings, nrings + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&rings_lock);
+    if (!r)
+      return NULL;
+  }
+  pthread_once(&ring_once, make_key);
+  pthread_setspecific(ring_key, r);
+  return my_ring = r;
+}
+
+/* sampled - whether to log this request (xorshift, seeded per thread) */
+static int sampled(void)
+{
+  if (log_sample <= 1)
+    return log_sample == 1;
+  if (!my_seed) // once per thread, spread apart (threads reuse TLS addresses)
+    my_seed = __atomic_add_fetch(&next_seed, 0x9e3779b9, __ATOMIC_RELAXED) | 1;
+  my_seed ^= my_seed << 13;
+  my_seed ^= my_seed >> 17;
+  my_seed ^= my_seed << 5;
+  return my_seed % log_sample == 0;
+}
+
+/* stamp - fill in the wall-clock arrival time and client address of [e] */
+static void stamp(int fd, struct plog_entry *e)
+{
+  uint64_t dur = DURATION(e);
+
+  clock_gettime(CLOCK_REALTIME, &e->ts);
+  e->ts.tv_sec -= dur / 1000000000;
+  e->ts.tv_nsec -= dur % 1000000000;
+  if (e->ts.tv_nsec < 0) {
+    e->ts.tv_sec--;
+    e->ts.tv_nsec += 1000000000;
+  }
+  e->clientlen = sizeof(e->client);
+  if (getpeername(fd, (struct sockaddr *)&e->client, &e->clientlen) < 0)
+    e->clientlen = 0;
+}
+
+/* keep_slow - put [e] among the slowest requests if it is still slow enough */
+static void keep_slow(int fd, struct plog_entry *e)
+{
+  uint64_t dur = DURATION(e), floor;
+  int i, min = 0;
+
+  pthread_mutex_lock(&slowest_lock);
+  if (nslowest < PLOG_SLOWEST)
+    min = nslowest++;
+  else {
+    for (i = 1; i < PLOG_SLOWEST; i++)
+      if (DURATION(&slowest[i]) < DURATION(&slowest[min]))
+        min = i;
+    if (dur <= DURATION(&slowest[min])) { // another thread got there first
+      pthread_mutex_unlock(&slowest_lock);
+      return;
+    }
+  }
+  slowest[min] = *e;
+  stamp(fd, &slowest[min]);
+  if (nslowest == PLOG_SLOWEST) {
+    floor = DURATION(&slowest[0]);
+    for (i = 1; i < PLOG_SLOWEST; i++)
+      if (DURATION(&slowest[i]) < floor)
+        floor = DURATION(&slowest[i]);
+    __atomic_store_n(&slow_floor, floor, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&slowest_lock);
+}
+
+/*
+ * plog_request - note [e] among the slowest requests if it is one, and
+ *                queue it for the access log if it is sampled, adding
+ *                the arrival time and the client address of [fd];
+ *                mark[PLOG_START] and mark[PLOG_END] must be set.
+ *                Never blocks, except briefly for a new slowest request
+ */
+void plog_request(int fd, struct plog_entry *e)
+{
+  struct plog_ring *r;
+  struct plog_entry *slot;
+  unsigned tail;
+
+  if (DURATION(e) > __atomic_load_n(&slow_floor, __ATOMIC_RELAXED))
+    keep_slow(fd, e);
+  if (!sampled())
+    return;
+  if (!(r = ring())) {
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  tail = r->tail;
+  if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == PLOG_RING) {
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  slot = &r->entries[tail % PLOG_RING];
+  *slot = *e;
+  stamp(fd, slot);
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/***********
+ * WRITER
+ ***********/
+
+/*
+ * write_entry - one access-log line: the request, then every phase in
+ *               ms ("-" if the request skipped it), then the time spent
+ *               writing to the client
+ */
+static void write_entry(FILE *fp, struct plog_entry *e)
+{
+  char host[NI_MAXHOST] = "-", date[32];
+  uint64_t prev = e->mark[PLOG_START];
+  struct tm tm;
+  int m;
+
+  if (e->clientlen)
+    getnameinfo((struct sockaddr *)&e->client, e->clientlen, host, sizeof(host),
+                NULL, 0, NI_NUMERICHOST);
+  gmtime_r(&e->ts.tv_sec, &tm);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+  fprintf(fp, "ts=%s.%03ldZ client=%s method=%s url=%s status=%d bytes=%lld cache=%s dur_ms=%.3f",
+          date, e->ts.tv_nsec / 1000000, host, e->method, e->url, e->status,
+          (long long)e->bytes, cache_names[e->cache], DURATION(e) / 1e6);
+  for (m = PLOG_START + 1; m < PLOG_NMARKS; m++) {
+    if (!e->mark[m]) {
+      fprintf(fp, " %s_ms=-", phase_names[m]);
+      continue;
+    }
+    fprintf(fp, " %s_ms=%.3f", phase_names[m], (e->mark[m] - prev) / 1e6);
+    prev = e->mark[m];
+  }
+  fprintf(fp, " write_ms=%.3f\n", e->write_ns / 1e6);
+}
+
+static int slower(const void *a, const void *b)
+{
+  uint64_t da = DURATION((const struct plog_entry *)a), db = DURATION((const struct plog_entry *)b);
+
+  return da < db ? 1 : da > db ? -1 : 0;
+}
+
+/* dump_slowest - write the slowest requests, slowest first, and forget them */
+static void dump_slowest(FILE *fp)
+{
+  static struct plog_entry copy[PLOG_SLOWEST];
+  int i, n;
+
+  pthread_mutex_lock(&slowest_lock);
+  n = nslowest;
+  memcpy(copy, slowest, n * sizeof(copy[0]));
+  nslowest = 0;
+  __atomic_store_n(&slow_floor, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&slowest_lock);
+
+  qsort(copy, n, sizeof(copy[0]), slower);
+  fprintf(fp, "# plog: %d slowest requests since the last SIGUSR1\n", n);
+  for (i = 0; i < n; i++)
+    write_entry(fp, &copy[i]);
+  fflush(fp);
+}
+
+/*
+ * writer - drain every ring in turn; when all are empty, flush, report
+ *          any newly dropped entries and wait for SIGUSR1 (checked
+ *          without waiting between busy passes). The wait starts at
+ *          PLOG_MIN_IDLE_MS and doubles while nothing arrives, up to
+ *          PLOG_IDLE_MS, so rings are emptied often under load and the
+ *          writer hardly wakes when there is none
+ */
+static void *writer(void *arg)
+{
+  struct timespec idle = {0, PLOG_MIN_IDLE_MS * 1000000L}, now = {0, 0};
+  struct plog_ring *r;
+  unsigned i, n, head, tail, written;
+  size_t drops, reported = 0;
+  sigset_t usr1;
+  int flushing;
+
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  while (1) {
+    written = 0;
+    flushing = __atomic_load_n(&flush_wanted, __ATOMIC_ACQUIRE); // before this pass looks at any ring
+    n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++) {
+      r = rings[i];
+      head = r->head;
+      tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, written++)
+        write_entry(log_fp, &r->entries[head % PLOG_RING]);
+      __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    }
+    if (written) {
+      idle.tv_nsec = PLOG_MIN_IDLE_MS * 1000000L;
+      if (sigtimedwait(&usr1, NULL, &now) == SIGUSR1)
+        dump_slowest(log_fp);
+      continue;
+    }
+    if ((drops = __atomic_load_n(&dropped, __ATOMIC_RELAXED)) != reported) {
+      fprintf(log_fp, "# plog: %zu entries dropped (rings full)\n", drops - reported);
+      reported = drops;
+    }
+    fflush(log_fp);
+    if (flushing)
+      __atomic_store_n(&flush_wanted, 0, __ATOMIC_RELEASE);
+    if (sigtimedwait(&usr1, NULL, &idle) == SIGUSR1)
+      dump_slowest(log_fp);
+    if ((idle.tv_nsec *= 2) > PLOG_IDLE_MS * 1000000L)
+      idle.tv_nsec = PLOG_IDLE_MS * 1000000L;
+  }
+  return NULL;
+}
+
+/*
+ * plog_close - wait (up to a second) until the writer has written and
+ *              flushed every entry queued before the call; for exiting
+ */
+void plog_close(void)
+{
+  struct timespec tick = {0, 10000000};
+  int i;
+
+  __atomic_store_n(&flush_wanted, 1, __ATOMIC_RELEASE);
+  for (i = 0; i < 100 && __atomic_load_n(&flush_wanted, __ATOMIC_ACQUIRE); i++)
+    nanosleep(&tick, NULL);
+}
+
+/*
+ * plog_init - log 1 request in [sample] (0: none, only SIGUSR1 dumps)
+ *             to [path] ("-" is stdout) and start the writer. Call it
+ *             before starting other threads: it blocks SIGUSR1 in the
+ *             caller, and they inherit that. Returns -1 on error
+ */
+int plog_init(const char *path, unsigned sample)
+{
+  pthread_t tid;
+  sigset_t usr1;
+
+  log_sample = sample;
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+  if (!strcmp(path, "-"))
+    log_fp = stdout;
+  else if (!(log_fp = fopen(path, "a")))
+    return -1;
+  setvbuf(log_fp, NULL, _IOFBF, 64 * 1024);
+  if (pthread_create(&tid, NULL, writer, NULL))
+    return -1;
+  pthread_detach(tid);
+  return 0;
+}
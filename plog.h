@@ -0,0 +1,75 @@
+/*
+ * plog.h
+ *
+ * Proxy Lab
+ *
+ * This is the header file for plog.c (asynchronous access log for
+ * proxy: per-thread rings drained by a writer thread, with the phase
+ * timings of each request and the slowest ones dumped on SIGUSR1)
+ */
+#ifndef __PLOG_H__
+#define __PLOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+
+/* Entries one thread can have waiting for the writer */
+#define PLOG_RING 128
+/* Most threads logging at once; past this, entries are dropped */
+#define PLOG_RINGS 128
+/* Bytes of the request URL kept per entry (longer ones are cut) */
+#define PLOG_URL 256
+/* How long the writer sleeps when every ring is empty: from the first
+   up to the second, doubling while nothing arrives */
+#define PLOG_MIN_IDLE_MS 1
+#define PLOG_IDLE_MS 50
+/* Slowest requests kept for the SIGUSR1 dump */
+#define PLOG_SLOWEST 10
+
+/* How the cache took part in a request */
+enum plog_cache {
+  PLOG_NONE, // not cacheable (or not a proxied request)
+  PLOG_HIT,
+  PLOG_MISS
+};
+
+/*
+ * Phase boundaries of a request, in ns on the CLOCK_MONOTONIC clock
+ * (pm_now); 0 if the request never got there. Each phase is logged as
+ * the time from the previous boundary reached.
+ */
+enum plog_mark {
+  PLOG_START,      // first request byte arrived
+  PLOG_READ,       // request headers read and parsed
+  PLOG_LOOKUP,     // cache looked up (and, on a hit, the object copied)
+  PLOG_RESOLVED,   // origin name resolved (getaddrinfo)
+  PLOG_CONNECTED,  // connected to the origin
+  PLOG_SENT,       // request written to the origin
+  PLOG_FIRST_BYTE, // first response byte from the origin
+  PLOG_END,        // response written to the client
+  PLOG_NMARKS
+};
+
+/* One access-log entry, filled in by the thread serving the request */
+struct plog_entry {
+  char method[16];
+  char url[PLOG_URL];
+  int status;         // response status, 0 if none was sent
+  int64_t bytes;      // response bytes written to the client
+  enum plog_cache cache;
+  uint64_t mark[PLOG_NMARKS];
+  uint64_t write_ns;  // time spent writing to the client (part of the last phase)
+  /* Filled in by plog_request */
+  struct timespec ts; // wall clock when the request arrived
+  struct sockaddr_storage client;
+  socklen_t clientlen;
+};
+
+/* Function prototypes for the access log */
+int plog_init(const char *path, unsigned sample);
+void plog_request(int fd, struct plog_entry *e);
+void plog_close(void);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * pmetrics.c
+ *
+ * Proxy Lab
+ *
+ * These are the proxy's metrics: counters of requests, bytes and cache
+ * outcomes, and a latency histogram for each request phase, rendered
+ * in the Prometheus text format when http://proxy.local/metrics is
+ * requested.
+ *
+ * Recording is an atomic add on memory that is almost never shared.
+ * Every thread is given one of PM_SLOTS slots, round-robin, the first
+ * time it records anything, and each slot sits on its own cache lines,
+ * so concurrent threads don't bounce lines between CPUs and take no
+ * locks. A slot can still be shared by two threads (there are more
+ * connections than slots), which is why the add is atomic. Reading
+ * sums all the slots; a scrape racing with updates sees each counter a
+ * few increments early or late, never torn.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "pmetrics.h"
+#include "pbuf.h"
+
+/* One thread's (or a few threads') share of every counter */
+struct pm_slot {
+  int64_t counters[PM_NCOUNTERS];
+  uint64_t buckets[PM_NPHASES][PM_BUCKETS + 1]; // last one is +Inf
+  uint64_t sum_ns[PM_NPHASES];
+} __attribute__((aligned(64)));
+
+static struct pm_slot slots[PM_SLOTS];
+static unsigned next_slot;
+static __thread struct pm_slot *my_slot;
+
+/* Upper bounds of the histogram buckets, in ns (1-2.5-5 steps) */
+static const uint64_t bounds[PM_BUCKETS] = {
+  100000, 250000, 500000,
+  1000000, 2500000, 5000000,
+  10000000, 25000000, 50000000,
+  100000000, 250000000, 500000000,
+  1000000000, 2500000000, 5000000000, 10000000000};
+
+static const struct {
+  const char *name, *type, *help;
+} counter_info[PM_NCOUNTERS] = {
+  {"proxy_requests_total", "counter", "Requests read from clients"},
+  {"proxy_client_bytes_in_total", "counter", "Request bytes read from clients"},
+  {"proxy_client_bytes_out_total", "counter", "Response bytes written to clients"},
+  {"proxy_origin_bytes_in_total", "counter", "Response bytes read from origins"},
+  {"proxy_cache_hits_total", "counter", "Requests answered from the cache"},
+  {"proxy_cache_misses_total", "counter", "Cacheable requests sent to the origin"},
+  {"proxy_cache_evictions_total", "counter", "Objects evicted from the cache"},
+  {"proxy_origin_connect_errors_total", "counter", "Origins that could not be resolved or connected to"},
+  {"proxy_active_connections", "gauge", "Client connections open now"},
+};
+
+static const char *phase_names[PM_NPHASES] = {
+  "connect", "first_byte", "transfer", "total_hit", "total_miss"};
+
+#define SLOT_ADD(v, n) __atomic_add_fetch(&(v), (n), __ATOMIC_RELAXED)
+#define SLOT_GET(v)    __atomic_load_n(&(v), __ATOMIC_RELAXED)
+
+
+/***********
+ * RECORDING
+ ***********/
+
+static struct pm_slot *slot(void)
+{
+  if (!my_slot)
+    my_slot = &slots[__atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % PM_SLOTS];
+  return my_slot;
+}
+
+/*
+ * pm_add - add [n] (may be negative, for gauges) to counter [c]
+ */
+void pm_add(enum pm_counter c, int64_t n)
+{
+  SLOT_ADD(slot()->counters[c], n);
+}
+
+/*
+ * pm_observe - record that phase [p] of a request took [ns]
+ */
+void pm_observe(enum pm_phase p, uint64_t ns)
+{
+  struct pm_slot *s = slot();
+  int b = 0;
+
+  while (b < PM_BUCKETS && ns > bounds[b])
+    b++;
+  SLOT_ADD(s->buckets[p][b], 1);
+  SLOT_ADD(s->sum_ns[p], ns);
+}
+
+/*
+ * pm_now - monotonic clock in ns, for timing phases
+ */
+uint64_t pm_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/***********
+ * REPORTING
+ ***********/
+
+/*
+ * pm_format - sum every slot and write the Prometheus text exposition
+ *             into [buf]; returns its length (truncated to size - 1)
+ */
+size_t pm_format(char *buf, size_t size)
+{
+  int64_t counters[PM_NCOUNTERS] = {0};
+  uint64_t buckets[PM_NPHASES][PM_BUCKETS + 1] = {{0}}, sum_ns[PM_NPHASES] = {0}, cum;
+  struct pbuf_stats pst;
+  size_t len = 0;
+  int i, c, p, b;
+
+#define OUT(...)                                              \
+  do {                                                        \
+    if (len < size)                                           \
+      len += snprintf(buf + len, size - len, __VA_ARGS__);    \
+  } while (0)
+
+  for (i = 0; i < PM_SLOTS; i++) {
+    for (c = 0; c < PM_NCOUNTERS; c++)
+      counters[c] += SLOT_GET(slots[i].counters[c]);
+    for (p = 0; p < PM_NPHASES; p++) {
+      for (b = 0; b <= PM_BUCKETS; b++)
+        buckets[p][b] += SLOT_GET(slots[i].buckets[p][b]);
+      sum_ns[p] += SLOT_GET(slots[i].sum_ns[p]);
+    }
+  }
+
+  for (c = 0; c < PM_NCOUNTERS; c++) {
+    OUT("# HELP %s %s\n", counter_info[c].name, counter_info[c].help);
+    OUT("# TYPE %s %s\n", counter_info[c].name, counter_info[c].type);
+    OUT("%s %lld\n", counter_info[c].name, (long long)counters[c]);
+  }
+
+  OUT("# HELP proxy_phase_seconds Time spent in each phase of a request\n");
+  OUT("# TYPE proxy_phase_seconds histogram\n");
+  for (p = 0; p < PM_NPHASES; p++) {
+    cum = 0;
+    for (b = 0; b < PM_BUCKETS; b++) {
+      cum += buckets[p][b];
+      OUT("proxy_phase_seconds_bucket{phase=\"%s\",le=\"%g\"} %llu\n",
+          phase_names[p], bounds[b] / 1e9, (unsigned long long)cum);
+    }
+    cum += buckets[p][PM_BUCKETS];
+    OUT("proxy_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+        phase_names[p], (unsigned long long)cum);
+    OUT("proxy_phase_seconds_sum{phase=\"%s\"} %.9f\n", phase_names[p], sum_ns[p] / 1e9);
+    OUT("proxy_phase_seconds_count{phase=\"%s\"} %llu\n", phase_names[p], (unsigned long long)cum);
+  }
+
+  pbuf_stats(&pst);
+  OUT("# HELP proxy_pbuf_in_use I/O buffers borrowed from the pool now\n");
+  OUT("# TYPE proxy_pbuf_in_use gauge\n");
+  OUT("proxy_pbuf_in_use %zu\n", pst.in_use);
+  OUT("# HELP proxy_pbuf_allocated I/O buffers that exist\n");
+  OUT("# TYPE proxy_pbuf_allocated gauge\n");
+  OUT("proxy_pbuf_allocated %zu\n", pst.allocated);
+  OUT("# HELP proxy_pbuf_high_water Most I/O buffers borrowed at once\n");
+  OUT("# TYPE proxy_pbuf_high_water gauge\n");
+  OUT("proxy_pbuf_high_water %zu\n", pst.high_water);
+  OUT("# HELP proxy_pbuf_gets_total I/O buffers handed out by the pool\n");
+  OUT("# TYPE proxy_pbuf_gets_total counter\n");
+  OUT("proxy_pbuf_gets_total %zu\n", pst.gets);
+  OUT("# HELP proxy_pbuf_tcache_hits_total I/O buffers handed out from the thread cache\n");
+  OUT("# TYPE proxy_pbuf_tcache_hits_total counter\n");
+  OUT("proxy_pbuf_tcache_hits_total %zu\n", pst.tcache_hits);
+  OUT("# HELP proxy_pbuf_exhausted_total Requests refused because the pool was exhausted\n");
+  OUT("# TYPE proxy_pbuf_exhausted_total counter\n");
+  OUT("proxy_pbuf_exhausted_total %zu\n", pst.exhausted);
+#undef OUT
+
+  return len < size ? len : size - 1;
+}
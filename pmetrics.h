@@ -0,0 +1,54 @@
+/*
+ * pmetrics.h
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pmetrics.c (counters and latency
+ * histograms for proxy, served in Prometheus text format)
+ */
+#ifndef __PMETRICS_H__
+#define __PMETRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Counter slots; threads are spread over them round-robin */
+#define PM_SLOTS 64
+/* Histogram bucket bounds run from 100 us to 10 s (plus +Inf) */
+#define PM_BUCKETS 16
+
+/* Host whose /metrics the proxy answers itself (http://proxy.local/metrics) */
+#define PM_HOST "proxy.local"
+
+/* Counters and gauges */
+enum pm_counter {
+  PM_REQUESTS,         // requests read from clients
+  PM_CLIENT_BYTES_IN,  // request bytes read from clients
+  PM_CLIENT_BYTES_OUT, // response bytes written to clients
+  PM_ORIGIN_BYTES_IN,  // response bytes read from origins
+  PM_CACHE_HITS,
+  PM_CACHE_MISSES,     // cacheable requests the cache couldn't answer
+  PM_CACHE_EVICTIONS,
+  PM_CONNECT_ERRORS,   // origins that couldn't be resolved or connected to
+  PM_ACTIVE_CONNS,     // gauge: client connections open now
+  PM_NCOUNTERS
+};
+
+/* Request phases with a latency histogram */
+enum pm_phase {
+  PM_CONNECT,    // resolve + connect to the origin
+  PM_FIRST_BYTE, // request sent -> first response byte from the origin
+  PM_TRANSFER,   // first byte -> last byte relayed to the client
+  PM_TOTAL_HIT,  // request read -> response sent, from the cache
+  PM_TOTAL_MISS, // request read -> response sent, from the origin
+  PM_NPHASES
+};
+
+/* Function prototypes for recording */
+void pm_add(enum pm_counter c, int64_t n);
+void pm_observe(enum pm_phase p, uint64_t ns);
+uint64_t pm_now(void);
+/* Function prototypes for reporting */
+size_t pm_format(char *buf, size_t size);
+
+#endif
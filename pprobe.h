@@ -0,0 +1,75 @@
+/*
+ * pprobe.h
+ *
+ * Proxy Lab
+ *
+ * Static tracepoints (USDT) for proxy and pcache. With <sys/sdt.h>
+ * (systemtap-sdt-dev) each PPROBEn compiles to a test of the probe's
+ * semaphore and, behind it, a nop plus a note in the binary that
+ * bpftrace, perf or systemtap can attach to while the proxy runs;
+ * without it, or with -DPPROBE_DISABLE, they compile to nothing. The
+ * tracer sets the semaphore while it is attached, and the arguments
+ * are evaluated only then, so an unwatched probe costs one load and a
+ * not-taken branch.
+ *
+ * Provider "proxy"; a probe written foo__bar is named foo-bar:
+ *   request__start  (fd, url)                  request read and parsed
+ *   request__done   (fd, url, status, bytes, ns)  response finished
+ *   cache__hit      (host:port, path, size)
+ *   cache__miss     (host:port, path)
+ *   cache__evict    (loc, size)                about to be evicted
+ *   connect__start  (host, port)
+ *   connect__done   (host, port, fd, ns)       fd < 0 if it failed
+ *   relay__bytes    (client fd, n)             n response bytes relayed
+ *
+ * e.g.  bpftrace -lv 'usdt:./proxy:*'
+ *       bpftrace -e 'usdt:./proxy:proxy:request__done
+ *                    { @ms[str(arg1)] = hist(arg4 / 1000000); }'
+ */
+#ifndef __PPROBE_H__
+#define __PPROBE_H__
+
+#if !defined(PPROBE_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1 // each probe's note names its semaphore
+#include <sys/sdt.h>
+#define PPROBE_ENABLED 1
+#endif
+#endif
+
+#ifdef PPROBE_ENABLED
+/* One semaphore per probe, in .probes where tracers look for it; weak,
+   so every file that includes this header shares the same one */
+#define PPROBE_SEMAPHORE(name) \
+  __extension__ volatile unsigned short proxy_##name##_semaphore \
+  __attribute__((weak, section(".probes")))
+PPROBE_SEMAPHORE(request__start);
+PPROBE_SEMAPHORE(request__done);
+PPROBE_SEMAPHORE(cache__hit);
+PPROBE_SEMAPHORE(cache__miss);
+PPROBE_SEMAPHORE(cache__evict);
+PPROBE_SEMAPHORE(connect__start);
+PPROBE_SEMAPHORE(connect__done);
+PPROBE_SEMAPHORE(relay__bytes);
+
+/* Nonzero while a tracer is attached to probe [name] */
+#define PPROBE_ACTIVE(name)             __builtin_expect(proxy_##name##_semaphore != 0, 0)
+
+#define PPROBE2(name, a, b) \
+  do { if (PPROBE_ACTIVE(name)) DTRACE_PROBE2(proxy, name, a, b); } while (0)
+#define PPROBE3(name, a, b, c) \
+  do { if (PPROBE_ACTIVE(name)) DTRACE_PROBE3(proxy, name, a, b, c); } while (0)
+#define PPROBE4(name, a, b, c, d) \
+  do { if (PPROBE_ACTIVE(name)) DTRACE_PROBE4(proxy, name, a, b, c, d); } while (0)
+#define PPROBE5(name, a, b, c, d, e) \
+  do { if (PPROBE_ACTIVE(name)) DTRACE_PROBE5(proxy, name, a, b, c, d, e); } while (0)
+#else
+#define PPROBE_ACTIVE(name)             0
+/* sizeof keeps the arguments "used" without evaluating them */
+#define PPROBE2(name, a, b)             ((void)sizeof(a), (void)sizeof(b))
+#define PPROBE3(name, a, b, c)          (PPROBE2(name, a, b), (void)sizeof(c))
+#define PPROBE4(name, a, b, c, d)       (PPROBE3(name, a, b, c), (void)sizeof(d))
+#define PPROBE5(name, a, b, c, d, e)    (PPROBE4(name, a, b, c, d), (void)sizeof(e))
+#endif
+
+#endif
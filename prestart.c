@@ -0,0 +1,191 @@
+/*
+ * prestart.c
+ *
+ * Proxy Lab
+ *
+ * This is hot restart for the proxy. A running proxy started with
+ * -H path listens on the Unix socket at path. A new proxy started with
+ * the same -H connects there first. The old proxy passes its listening
+ * TCP sockets across (SCM_RIGHTS; one, or one per acceptor thread with
+ * -a) and then streams a snapshot of its cache (cache_save). The new
+ * proxy accepts on the very same sockets,
+ * so connections that arrive during the switch wait in its backlog
+ * instead of being refused. Its cache starts out warm, so the switch
+ * doesn't send a burst of misses to the origins. The old proxy then
+ * stops accepting and drains its connections. The new proxy binds the
+ * Unix socket afresh, ready for the next restart.
+ *
+ * If nothing answers at path (first start, or the old proxy died), the
+ * new proxy opens its own listening socket with an empty cache.
+ */
+
+#include "csapp.h"
+#include "prestart.h"
+#include <sys/un.h>
+
+
+/*********************
+ * PASSING DESCRIPTORS
+ *********************/
+
+/*
+ * send_fds - send the [n] descriptors [fds] (and one byte) over Unix
+ *            socket [sock]; returns 0, or -1 on error
+ */
+static int send_fds(int sock, int *fds, int n)
+{
+  struct msghdr msg;
+  struct iovec iov = {"L", 1};
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * PRESTART_MAX_FDS)];
+    struct cmsghdr align;
+  } u;
+  struct cmsghdr *cmsg;
+
+  if (n < 1 || n > PRESTART_MAX_FDS)
+    return -1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = u.buf;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+  return sendmsg(sock, &msg, 0) == 1 ? 0 : -1;
+}
+
+/*
+ * recv_fds - receive the descriptors sent by send_fds on [sock] into
+ *            [fds] (room for PRESTART_MAX_FDS); returns how many, or -1
+ */
+static int recv_fds(int sock, int *fds)
+{
+  struct msghdr msg;
+  char byte;
+  struct iovec iov = {&byte, 1};
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * PRESTART_MAX_FDS)];
+    struct cmsghdr align;
+  } u;
+  struct cmsghdr *cmsg;
+  int n;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = u.buf;
+  msg.msg_controllen = sizeof(u.buf);
+  if (recvmsg(sock, &msg, 0) != 1)
+    return -1;
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    return -1;
+  n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * n);
+  return n > 0 ? n : -1;
+}
+
+/*
+ * unix_addr - fill [addr] with the Unix socket address [path];
+ *             returns -1 if the path is too long
+ */
+static int unix_addr(struct sockaddr_un *addr, char *path)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return -1;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+
+/***********
+ * RESTART
+ ***********/
+
+/*
+ * prestart_listen - listen for a successor on Unix socket [path],
+ *                   replacing any socket left there;
+ *                   returns the listening descriptor, or -1
+ */
+int prestart_listen(char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (unix_addr(&addr, path) < 0 || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+  unlink(path);
+  if (bind(fd, (SA *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * prestart_takeover - ask the proxy listening on [path] for its
+ *                     listening sockets, stored in [fds] (room for
+ *                     PRESTART_MAX_FDS), and load its cache into [cash]
+ *                     (no other thread may use it yet); returns the
+ *                     number of sockets, or -1 if no proxy handed any over
+ */
+int prestart_takeover(char *path, int *fds, cache *cash)
+{
+  struct sockaddr_un addr;
+  struct timeval tv = {PRESTART_TIMEOUT, 0};
+  int sock, nfds, n;
+
+  if (unix_addr(&addr, path) < 0 || (sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+  if (connect(sock, (SA *)&addr, sizeof(addr)) < 0) { // Nobody there: a cold start
+    close(sock);
+    return -1;
+  }
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if ((nfds = recv_fds(sock, fds)) < 0) {
+    fprintf(stderr, "prestart: %s answered but sent no socket\n", path);
+    close(sock);
+    return -1;
+  }
+  if ((n = cache_load(cash, sock)) < 0)
+    fprintf(stderr, "prestart: cache snapshot cut short, keeping what arrived\n");
+  else
+    fprintf(stderr, "prestart: took over %d listening socket(s) and %d cached objects\n", nfds, n);
+  close(sock);
+  return nfds;
+}
+
+/*
+ * prestart_handoff - accept a successor on [hrfd] and pass it the [nfds]
+ *                    listening sockets [fds] and a snapshot of [cash]
+ *                    (taken under the read lock [lock]); returns 0 once
+ *                    the sockets are handed over (the caller must then
+ *                    stop accepting), -1 if they weren't
+ */
+int prestart_handoff(int hrfd, int *fds, int nfds, cache *cash, pthread_rwlock_t *lock)
+{
+  struct timeval tv = {PRESTART_TIMEOUT, 0};
+  int sock, n;
+
+  if ((sock = accept(hrfd, NULL, NULL)) < 0)
+    return -1;
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if (send_fds(sock, fds, nfds) < 0) {
+    close(sock);
+    return -1;
+  }
+  Pthread_rwlock_rdlock(lock);
+  n = cache_save(cash, sock);
+  Pthread_rwlock_unlock(lock);
+  if (n < 0)
+    fprintf(stderr, "prestart: successor stopped reading the cache snapshot\n");
+  else
+    fprintf(stderr, "prestart: handed over %d listening socket(s) and %d cached objects\n", nfds, n);
+  close(sock);
+  return 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * prestart.h
+ *
+ * Proxy Lab
+ *
+ * This is the header file for prestart.c (hot restart for proxy: a new
+ * process takes over the old one's listening sockets and cache)
+ */
+#ifndef __PRESTART_H__
+#define __PRESTART_H__
+
+#include <pthread.h>
+#include "pcache.h"
+
+/* Longest an old proxy waits for its successor to read the cache */
+#define PRESTART_TIMEOUT 5
+/* Most listening sockets handed over at once (one per acceptor) */
+#define PRESTART_MAX_FDS 64
+
+/* Function prototypes for hot restart */
+int prestart_listen(char *path);
+int prestart_takeover(char *path, int *fds, cache *cash);
+int prestart_handoff(int hrfd, int *fds, int nfds, cache *cash, pthread_rwlock_t *lock);
+
+#endif
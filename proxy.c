@@ -1,9 +1,17 @@
+#define _GNU_SOURCE // ppoll
 #include <stdio.h>
 #include "csapp.h"
+#include "phttp.h"
+#include "pbuf.h"
+#include "pcache.h" // 권장되는 최대 캐시 및 오브젝트 크기도 여기에
+#include "pmetrics.h"
+#include "plog.h"
+#include "pprobe.h"
+#include "prestart.h"
+#include <poll.h>
 
-/* 권장되는 최대 캐시 및 오브젝트 크기 */
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+/* 연결 스레드 스택 크기: 큰 버퍼는 pbuf 풀에서 빌리므로 기본 8MB까지 필요 없음 */
+#define THREAD_STACK_SIZE (256 * 1024)
 
 /* 스타일 점수를 잃지 않으셔도 됩니다. 아래의 긴 줄을 코드에 포함시키는 것은 괜찮습니다. */
 static const char *user_agent_hdr =
@@ -11,40 +19,271 @@ static const char *user_agent_hdr =
     "Firefox/10.0.3\r\n";
 static const char *new_version = "HTTP/1.0";
 
+/* 프록시가 직접 채우는 헤더와 전달하면 안 되는 hop-by-hop 헤더 */
+static const char *dropped_hdrs[] = {
+    "Host", "User-Agent", "Connection", "Proxy-Connection", "Keep-Alive",
+    "TE", "Trailer", "Transfer-Encoding", "Upgrade", "Proxy-Authorization",
+    "Content-Length", // 요청 본문은 전달하지 않음 (GET/HEAD만 받음)
+    NULL};
+
+/* 요청 라인 + 고정 헤더 + 클라이언트 헤더(줄마다 최대 2개) + 빈 줄 */
+#define REQ_IOV_MAX (2 * PHTTP_MAX_HEADERS + 16)
+/* 206 응답 헤더 + 범위마다 (파트 헤더, 본문 조각) + 마지막 구분자 */
+#define RANGE_IOV_MAX (2 * PHTTP_MAX_RANGES + 2)
+/* /metrics 응답 본문 최대 크기 */
+#define METRICS_MAX (32 * 1024)
+/* 종료할 때 처리 중인 연결을 기다리는 기본 시간 (초) */
+#define DRAIN_SECS 10
+/* -a: 수신 스레드 최대 개수 (스레드마다 SO_REUSEPORT 수신 소켓 하나, 재시작 때 모두 넘겨줌) */
+#define MAX_ACCEPTORS PRESTART_MAX_FDS
+
+/* 스레드들이 공유하는 웹 오브젝트 캐시와 읽기-쓰기 락 */
+static cache web_cache;
+static pthread_rwlock_t cache_lock;
+
+/* -v: 요청/응답 헤더를 stdout에 그대로 출력 (디버깅용, 동기 출력이라 느림) */
+static int verbose;
+
+/* 처리 중인 연결 수 (종료할 때 이만큼 기다림), SIGTERM/SIGINT를 받으면 1 */
+static int active_conns;
+static volatile sig_atomic_t stopping;
+
+/* 수신 소켓들: [0]은 메인 스레드가, 나머지는 각자의 수신 스레드가 accept.
+   stop_pipe의 쓰기 쪽을 닫으면 수신 스레드들이 깨어나 종료 */
+static int listenfds[MAX_ACCEPTORS], nlisten;
+static pthread_t acceptors[MAX_ACCEPTORS];
+static int stop_pipe[2] = {-1, -1};
+static pthread_attr_t conn_attr;
+
 /* 함수 프로토타입 */
 void *thread_func(void *arg);
 void handle_request(int proxy_connfd);
-void send_request(int p_clientfd, char *method, char *uri_ptos, char *host);
-void handle_response(int p_connfd, int p_clientfd);
-int parse_uri(char *uri, char *uri_ptos, char *host, char *port);
+ssize_t read_request(int fd, char *buf, size_t size, struct phttp_request *req);
+void send_request(int p_clientfd, struct phttp_request *req, slice *uri_ptos, char *host);
+int is_dropped_hdr(struct phttp_request *req, slice *name);
+void iov_add(struct iovec *iov, int *iovcnt, const void *base, size_t len);
+void handle_response(int p_connfd, int p_clientfd, char *hostport, char *path, struct plog_entry *le);
+int parse_uri(slice *uri, slice *uri_ptos, char *host, char *port);
+int serve_from_cache(int fd, char *hostport, char *path, slice *range, struct plog_entry *le);
+ssize_t send_cached(int fd, char *obj, size_t size, slice *range, int *status);
+size_t serve_metrics(int fd);
+void cache_response(char *hostport, char *path, char *obj, size_t size);
+int connect_origin(char *host, char *port, uint64_t start, struct plog_entry *le);
+void finish_request(int fd, struct plog_entry *le);
+int wait_readable(int fd);
+void send_unavailable(int fd);
+void send_bad_gateway(int fd);
+void send_not_implemented(int fd);
+void usage(char *prog);
+void stop_handler(int sig);
+void open_listeners(char *port, int n);
+void *acceptor_func(void *arg);
+void accept_one(int listenfd);
+void drain(int hrfd, int secs);
 
 int main(int argc, char **argv)
 {
-  int listenfd;
-  char hostname[MAXLINE], port[MAXLINE];
+  int hrfd = -1, c, i, drain_secs = DRAIN_SECS, nacceptors = 1;
+  char *log_path = "-", *hr_path = NULL;
+  unsigned log_sample = 1;
+  struct pollfd pfd[2];
+  sigset_t stops, waitmask;
+
+  /* 명령행 인수 확인 */
+  while ((c = getopt(argc, argv, "vl:s:d:H:a:")) != -1)
+  {
+    switch (c)
+    {
+    case 'v': verbose = 1; break;
+    case 'l': log_path = optarg; break;
+    case 's': log_sample = strtoul(optarg, NULL, 10); break;
+    case 'd': drain_secs = atoi(optarg); break;
+    case 'H': hr_path = optarg; break;
+    case 'a': nacceptors = atoi(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || nacceptors < 1 || nacceptors > MAX_ACCEPTORS)
+    usage(argv[0]);
+  Signal(SIGPIPE, SIG_IGN); // 먼저 끊은 클라이언트/서버에 쓰다가 프로세스 전체가 죽지 않도록
+
+  /* SIGTERM/SIGINT는 다른 모든 스레드에서 막아 두고(연결 스레드의 시스템 콜이 끊기지 않도록)
+     메인 스레드의 ppoll에서만 받음: 스레드를 만들기 전에 막아야 물려받음 */
+  Signal(SIGTERM, stop_handler);
+  Signal(SIGINT, stop_handler);
+  sigemptyset(&stops);
+  sigaddset(&stops, SIGTERM);
+  sigaddset(&stops, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &stops, NULL);
+
+  if (plog_init(log_path, log_sample) < 0) // 접근 로그는 백그라운드 스레드가 씀
+    unix_error("plog_init error");
+  cache_init(&web_cache, &cache_lock);
+
+  /* -H: 같은 경로에서 돌고 있는 프록시가 있으면 수신 소켓들과 캐시를 넘겨받고,
+     없으면 지정된 포트에 대한 수신 소켓 생성. 어느 쪽이든 다음 재시작을 위해 그 경로에서 대기 */
+  if (hr_path && (nlisten = prestart_takeover(hr_path, listenfds, &web_cache)) < 0)
+    nlisten = 0;
+  open_listeners(argv[optind], nacceptors);
+  if (hr_path && (hrfd = prestart_listen(hr_path)) < 0)
+    unix_error("prestart_listen error");
+  for (i = 0; i < nlisten; i++) // 넘겨주는 동안엔 두 프로세스가 같은 소켓을 poll
+    fcntl(listenfds[i], F_SETFL, fcntl(listenfds[i], F_GETFL) | O_NONBLOCK);
+
+  pthread_sigmask(SIG_BLOCK, NULL, &waitmask); // ppoll 하는 동안만 SIGTERM/SIGINT를 받음
+  sigdelset(&waitmask, SIGTERM);
+  sigdelset(&waitmask, SIGINT);
+
+  pthread_attr_init(&conn_attr);
+  pthread_attr_setstacksize(&conn_attr, THREAD_STACK_SIZE);
+
+  /* -a n: 소켓 [1..n-1]은 각자의 수신 스레드가 받고, 메인 스레드는 [0]과 재시작 소켓, 시그널 담당 */
+  if (nlisten > 1 && pipe(stop_pipe) < 0)
+    unix_error("pipe error");
+  for (i = 1; i < nlisten; i++)
+    Pthread_create(&acceptors[i], &conn_attr, acceptor_func, &listenfds[i]);
+
+  while (!stopping)
+  {
+    pfd[0].fd = listenfds[0];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = hrfd; // -1이면 poll이 무시
+    pfd[1].events = POLLIN;
+    if (ppoll(pfd, 2, NULL, &waitmask) < 0)
+    {
+      if (errno != EINTR)
+        unix_error("ppoll error");
+      continue;
+    }
+    if ((pfd[1].revents & POLLIN) &&
+        prestart_handoff(hrfd, listenfds, nlisten, &web_cache, &cache_lock) == 0)
+      break; // 새 프로세스가 수신 소켓들을 받았으니 여기서는 그만 받음
+    if (pfd[0].revents & POLLIN)
+      accept_one(listenfds[0]);
+  }
+  drain(hrfd, drain_secs);
+  return 0;
+}
+
+void usage(char *prog)
+{
+  fprintf(stderr, "사용법: %s [-v] [-l 로그파일] [-s n] [-d 초] [-H 소켓경로] [-a n] <포트>\n", prog);
+  fprintf(stderr, "  -v  요청/응답 헤더를 stdout에 출력 (디버깅용)\n");
+  fprintf(stderr, "  -l  접근 로그를 쓸 파일 (기본 -, stdout)\n");
+  fprintf(stderr, "  -s  요청 n개 중 1개만 접근 로그에 기록 (기본 1, 0 = 기록 안 함)\n");
+  fprintf(stderr, "  -d  SIGTERM/SIGINT 후 처리 중인 연결을 기다리는 최대 시간 (기본 %d초)\n", DRAIN_SECS);
+  fprintf(stderr, "  -H  무중단 재시작용 유닉스 소켓: 같은 경로로 새 프록시를 띄우면 수신 소켓과 캐시를\n"
+                  "      넘겨받고, 기존 프록시는 새 연결을 그만 받고 처리 중인 연결을 마친 뒤 종료\n");
+  fprintf(stderr, "  -a  수신 스레드 n개가 각자의 SO_REUSEPORT 수신 소켓에서 accept (기본 1, 최대 %d)\n",
+          MAX_ACCEPTORS);
+  fprintf(stderr, "SIGUSR1을 받으면 마지막 SIGUSR1 이후 가장 느렸던 요청 %d개를 단계별 시간과 함께 로그에 씀\n",
+          PLOG_SLOWEST);
+  exit(1);
+}
+
+/* stop_handler: SIGTERM/SIGINT => 새 연결을 그만 받고 drain */
+void stop_handler(int sig)
+{
+  stopping = 1;
+}
+
+/* open_listeners: port에 대한 수신 소켓을 n개까지 채움 (넘겨받은 소켓이 있으면 그 뒤에).
+   하나면 예전처럼 Open_listenfd, 여럿이면 모두 SO_REUSEPORT로 열어 커널이 새 연결을 나눠 줌 */
+void open_listeners(char *port, int n)
+{
+  int fd;
+
+  if (nlisten == 0 && n == 1)
+  {
+    listenfds[nlisten++] = Open_listenfd(port);
+    return;
+  }
+  while (nlisten < n)
+  {
+    if ((fd = open_listenfd_reuseport(port)) < 0)
+    {
+      if (nlisten == 0)
+        unix_error("Open_listenfd_reuseport error");
+      /* 넘겨받은 소켓이 SO_REUSEPORT 없이 열린 경우: 그 소켓들만으로 받음 */
+      fprintf(stderr, "proxy: 수신 소켓을 더 열 수 없어 %d개로 받음\n", nlisten);
+      return;
+    }
+    listenfds[nlisten++] = fd;
+  }
+}
+
+/* acceptor_func: 수신 스레드. 자기 소켓에서만 accept 하다가 stop_pipe가 닫히면 소켓을 닫고 종료 */
+void *acceptor_func(void *arg)
+{
+  int listenfd = *(int *)arg;
+  struct pollfd pfd[2];
+
+  pfd[0].fd = listenfd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = stop_pipe[0];
+  pfd[1].events = POLLIN;
+  for (;;)
+  {
+    if (poll(pfd, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      unix_error("poll error");
+    }
+    if (pfd[1].revents) // 쓰기 쪽이 닫힘 (POLLHUP)
+      break;
+    if (pfd[0].revents & POLLIN)
+      accept_one(listenfd);
+  }
+  Close(listenfd); // 넘겨준 경우엔 새 프로세스의 사본이 계속 받음
+  return NULL;
+}
+
+/* accept_one: listenfd에서 연결 하나를 받아 연결마다 새로운 스레드 생성 */
+void accept_one(int listenfd)
+{
   socklen_t clientlen;
   struct sockaddr_storage clientaddr;
   pthread_t tid;
+  int connfd, *connfdp;
 
-  /* 명령행 인수 확인 */
-  if (argc != 2)
+  clientlen = sizeof(clientaddr);
+  connfd = accept(listenfd, (SA *)&clientaddr, &clientlen);
+  if (connfd < 0) // 다른 프로세스가 먼저 가져갔거나(EAGAIN) 클라이언트가 먼저 끊음
+    return;
+  connfdp = malloc(sizeof(int));
+  *connfdp = connfd;
+
+  __atomic_add_fetch(&active_conns, 1, __ATOMIC_RELAXED);
+  if (pthread_create(&tid, &conn_attr, thread_func, connfdp) != 0) // 스레드를 못 만들면 연결을 닫고 drain이 기다리지 않게 되돌림
   {
-    fprintf(stderr, "사용법: %s <포트>\n", argv[0]);
-    exit(1);
+    __atomic_sub_fetch(&active_conns, 1, __ATOMIC_RELAXED);
+    close(connfd);
+    free(connfdp);
   }
-  /* 지정된 포트에 대한 수신 소켓 생성 */
-  listenfd = Open_listenfd(argv[1]);
+}
 
-  while (1)
-  {
-    clientlen = sizeof(clientaddr);
-    int *connfdp = malloc(sizeof(int));
-    *connfdp = Accept(listenfd, (SA *)&clientaddr, &clientlen);
+/* drain: 수신 소켓들을 닫고 처리 중인 연결이 끝나기를 최대 secs초 기다린 뒤, 접근 로그를 비우고 종료 */
+void drain(int hrfd, int secs)
+{
+  struct timespec tick = {0, 100000000}; // 0.1초
+  int i, left;
 
-    /* 각 클라이언트 연결마다 새로운 스레드 생성 */
-    pthread_create(&tid, NULL, thread_func, connfdp);
+  if (nlisten > 1) // 수신 스레드들을 깨워서 각자 자기 소켓을 닫고 끝나기를 기다림
+  {
+    Close(stop_pipe[1]);
+    for (i = 1; i < nlisten; i++)
+      Pthread_join(acceptors[i], NULL);
   }
-  return 0;
+  Close(listenfds[0]); // 넘겨준 경우엔 새 프로세스의 사본이 계속 받음
+  if (hrfd >= 0)
+    Close(hrfd);
+  for (i = 0; i < secs * 10 && __atomic_load_n(&active_conns, __ATOMIC_RELAXED) > 0; i++)
+    nanosleep(&tick, NULL);
+  if ((left = __atomic_load_n(&active_conns, __ATOMIC_RELAXED)) > 0)
+    fprintf(stderr, "proxy: %d초가 지나 연결 %d개를 끊고 종료\n", secs, left);
+  plog_close();
+  exit(0);
 }
 
 void *thread_func(void *arg)
@@ -53,8 +292,11 @@ void *thread_func(void *arg)
   pthread_detach(pthread_self());
   Free(arg);
 
+  pm_add(PM_ACTIVE_CONNS, 1);
   handle_request(p_connfd);
   Close(p_connfd);
+  pm_add(PM_ACTIVE_CONNS, -1);
+  __atomic_sub_fetch(&active_conns, 1, __ATOMIC_RELAXED);
 
   return NULL;
 }
@@ -74,67 +316,549 @@ void *thread_func(void *arg)
 
 void handle_request(int proxy_connfd)
 {
-  int server_connfd;
-  char buf[MAXLINE], host[MAXLINE], port[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-  char transformed_uri[MAXLINE];
-  rio_t rio;
+  int server_connfd, cacheable;
+  ssize_t reqlen;
+  slice *accept_enc;
+  char *buf, host[NI_MAXHOST], port[NI_MAXSERV];
+  char hostport[NI_MAXHOST + NI_MAXSERV + 1], path[MAXLINE];
+  slice transformed_uri;
+  struct phttp_request req;
+  struct plog_entry le = {.cache = PLOG_NONE};
+  uint64_t t;
+
+  /* 요청이 도착할 때까지는 버퍼 없이 대기하고, 읽을 데이터가 생기면 풀에서 빌림 */
+  if (wait_readable(proxy_connfd) < 0)
+    return;
+  le.mark[PLOG_START] = pm_now(); // 요청 처리 시간은 첫 바이트가 도착한 때부터 (단계별 시각은 plog.h 참고)
+  if (!(buf = pbuf_get())) // 풀 소진
+  {
+    send_unavailable(proxy_connfd);
+    return;
+  }
 
   /* 클라이언트로부터 요청 라인과 헤더 읽기 */
-  Rio_readinitb(&rio, proxy_connfd); // rio 버퍼를 프록시의 연결 파일 디스크립터(proxy_connfd)와 연결
-  Rio_readlineb(&rio, buf, MAXLINE); // rio(프록시의 연결 파일 디스크립터)에서 한 줄(요청 라인)을 읽고 buf에 저장
-  printf("프록시로부터의 요청 헤더:\n");
-  printf("%s", buf);
-  sscanf(buf, "%s %s %s", method, uri, version); // buf에서 세 개의 문자열을 읽어서 각각 method, uri, version에 저장
-
-  /* GET 요청에서 URI 파싱 */
-  parse_uri(uri, transformed_uri, host, port);
-
-  server_connfd = Open_clientfd(host, port);                  // 서버에 연결하고 서버의 연결 파일 디스크립터(server_connfd)를 가져옴
-  send_request(server_connfd, method, transformed_uri, host); // 서버의 연결 파일 디스크립터에 요청 헤더를 보내고 동시에 서버의 연결 파일 디스크립터에도 씀
-  handle_response(proxy_connfd, server_connfd);
+  if ((reqlen = read_request(proxy_connfd, buf, PBUF_SIZE, &req)) < 0 || // 헤더 블록 전체를 buf에 읽고 슬라이스로 토크나이즈
+      parse_uri(&req.uri, &transformed_uri, host, port) < 0)            // GET 요청에서 URI 파싱
+  {
+    pbuf_put(buf);
+    return;
+  }
+  le.mark[PLOG_READ] = pm_now();
+  pm_add(PM_REQUESTS, 1);
+  pm_add(PM_CLIENT_BYTES_IN, reqlen);
+  snprintf(le.method, sizeof(le.method), "%.*s", (int)req.method.len, req.method.ptr); // buf는 응답 전에 반납하므로 복사
+  snprintf(le.url, sizeof(le.url), "%.*s", (int)req.uri.len, req.uri.ptr);
+  PPROBE2(request__start, proxy_connfd, le.url);
+  if (!phttp_slice_eq(req.method, "GET") && !phttp_slice_eq(req.method, "HEAD")) // 본문이 있는 요청은 전달하지 않음 (tiny처럼 501)
+  {
+    pbuf_put(buf);
+    send_not_implemented(proxy_connfd);
+    le.status = 501;
+    finish_request(proxy_connfd, &le);
+    return;
+  }
+  if (!strcmp(host, PM_HOST) && phttp_slice_eq(transformed_uri, "/metrics")) // 프록시 자신의 지표
+  {
+    pbuf_put(buf);
+    le.bytes = serve_metrics(proxy_connfd);
+    le.status = 200;
+    finish_request(proxy_connfd, &le);
+    return;
+  }
+  if (verbose)
+  {
+    printf("프록시로부터의 요청 헤더:\n");
+    printf("%.*s", (int)reqlen, buf);
+  }
+
+  /* GET 요청은 host:port + path (+ Accept-Encoding: 서버가 그에 따라 압축본을 줄 수 있음) 를 키로 캐시 확인
+     (Range 요청도 캐시된 전체 오브젝트에서 잘라서 응답) */
+  accept_enc = phttp_find_header(req.headers, req.num_headers, "Accept-Encoding");
+  cacheable = phttp_slice_eq(req.method, "GET") &&
+              transformed_uri.len + (accept_enc ? accept_enc->len + 2 : 0) < MAXLINE;
+  if (cacheable)
+  {
+    sprintf(hostport, "%s:%s", host, port);
+    memcpy(path, transformed_uri.ptr, transformed_uri.len);
+    path[transformed_uri.len] = '\0';
+    if (accept_enc)
+      sprintf(path + transformed_uri.len, "\n%.*s", (int)accept_enc->len, accept_enc->ptr);
+    if (serve_from_cache(proxy_connfd, hostport, path,
+                         phttp_find_header(req.headers, req.num_headers, "Range"), &le))
+    {
+      pbuf_put(buf);
+      pm_add(PM_CACHE_HITS, 1);
+      le.cache = PLOG_HIT;
+      finish_request(proxy_connfd, &le);
+      pm_observe(PM_TOTAL_HIT, le.mark[PLOG_END] - le.mark[PLOG_START]);
+      return;
+    }
+    pm_add(PM_CACHE_MISSES, 1);
+    le.cache = PLOG_MISS;
+  }
+
+  t = pm_now();
+  if ((server_connfd = connect_origin(host, port, t, &le)) < 0)       // 서버에 연결하고 서버의 연결 파일 디스크립터(server_connfd)를 가져옴
+  {                                                                 // (연결이 안 되는 서버 하나 때문에 프록시가 종료되면 안 됨)
+    pm_add(PM_CONNECT_ERRORS, 1);
+    pbuf_put(buf);
+    send_bad_gateway(proxy_connfd); // 빈 응답 대신 502
+    le.status = 502;
+    finish_request(proxy_connfd, &le);
+    return;
+  }
+  pm_observe(PM_CONNECT, le.mark[PLOG_CONNECTED] - t); // DNS 조회 + 연결
+  send_request(server_connfd, &req, &transformed_uri, host);        // 서버의 연결 파일 디스크립터에 요청 헤더를 보내고 동시에 서버의 연결 파일 디스크립터에도 씀 (Range 헤더도 그대로 전달)
+  le.mark[PLOG_SENT] = pm_now();
+  pbuf_put(buf);                                                    // 요청 슬라이스는 더 이상 필요 없으므로 응답을 기다리는 동안 반납
+  handle_response(proxy_connfd, server_connfd,
+                  cacheable ? hostport : NULL, path, &le);          // 응답을 전달하면서 캐시할 수 있으면 모아 둠
   Close(server_connfd); // 서버 연결 파일 디스크립터 닫기
+  finish_request(proxy_connfd, &le);
+  pm_observe(PM_TOTAL_MISS, le.mark[PLOG_END] - le.mark[PLOG_START]);
 }
 
-/* send_request: 프록시 => 서버 */
-void send_request(int p_clientfd, char *method, char *uri_ptos, char *host)
+/* finish_request: 응답이 끝난 시각을 기록하고 request__done 프로브와 접근 로그에 넘김 */
+void finish_request(int fd, struct plog_entry *le)
 {
-  char buf[MAXLINE];
-  printf("서버로 보내는 요청 헤더: \n");
-  printf("%s %s %s\n", method, uri_ptos, new_version);
+  le->mark[PLOG_END] = pm_now();
+  PPROBE5(request__done, fd, le->url, le->status, le->bytes, le->mark[PLOG_END] - le->mark[PLOG_START]);
+  plog_request(fd, le);
+}
 
-  /* 요청 헤더 읽기 */
-  sprintf(buf, "GET %s %s\r\n", uri_ptos, new_version);   // GET /index.html HTTP/1.0
-  sprintf(buf, "%sHost: %s\r\n", buf, host);              // Host: www.google.com
-  sprintf(buf, "%s%s", buf, user_agent_hdr);              // User-Agent: ~(bla bla)
-  sprintf(buf, "%sConnections: close\r\n", buf);          // Connections: close
-  sprintf(buf, "%sProxy-Connection: close\r\n\r\n", buf); // Proxy-Connection: close
+/* connect_origin: open_clientfd와 같지만 이름 조회(getaddrinfo)가 끝난 시각과 연결된 시각을 le에 기록
+   (start는 호출자가 연결을 시작한 시각, 오류 시 getaddrinfo 실패면 -2, 연결 실패면 -1) */
+int connect_origin(char *host, char *port, uint64_t start, struct plog_entry *le)
+{
+  struct addrinfo hints, *listp, *p;
+  int fd = -1;
 
-  /* Rio_writen: buf에서 p_clientfd로 strlen(buf)바이트 전송 */
-  Rio_writen(p_clientfd, buf, (size_t)strlen(buf)); // => 요청을 보내는 행위 자체
+  PPROBE2(connect__start, host, port);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  if (getaddrinfo(host, port, &hints, &listp) != 0)
+  {
+    PPROBE4(connect__done, host, port, -2, pm_now() - start);
+    return -2;
+  }
+  le->mark[PLOG_RESOLVED] = pm_now();
+
+  for (p = listp; p; p = p->ai_next) // 연결되는 주소가 나올 때까지
+  {
+    if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(listp);
+  if (fd >= 0)
+    le->mark[PLOG_CONNECTED] = pm_now();
+  PPROBE4(connect__done, host, port, fd, pm_now() - start); // 인수는 트레이서가 붙어 있을 때만 계산
+  return fd;
 }
 
-/* handle_response: 서버 => 프록시 */
-void handle_response(int p_connfd, int p_clientfd)
+/* serve_metrics: http://proxy.local/metrics 요청에 지표를 Prometheus 텍스트 형식으로 응답, 보낸 바이트 수 반환 */
+size_t serve_metrics(int fd)
 {
-  char buf[MAX_CACHE_SIZE];
+  char *body = Malloc(METRICS_MAX), hdr[MAXLINE];
+  size_t len = pm_format(body, METRICS_MAX), sent = 0;
+
+  sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %zu\r\n\r\n", len);
+  if (rio_writen(fd, hdr, strlen(hdr)) > 0 && rio_writen(fd, body, len) > 0)
+    sent = strlen(hdr) + len;
+  pm_add(PM_CLIENT_BYTES_OUT, sent);
+  Free(body);
+  return sent;
+}
+
+/* wait_readable: fd에 읽을 데이터(또는 EOF)가 생길 때까지 버퍼 없이 대기 */
+int wait_readable(int fd)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+
+  while (poll(&pfd, 1, -1) < 0)
+    if (errno != EINTR)
+      return -1;
+  return 0;
+}
+
+/* send_unavailable: 버퍼 풀이 바닥났을 때 클라이언트에게 503 응답 */
+void send_unavailable(int fd)
+{
+  static const char resp[] = "HTTP/1.0 503 Service Unavailable\r\n"
+                             "Content-length: 0\r\n\r\n";
+
+  rio_writen(fd, (void *)resp, sizeof(resp) - 1);
+}
+
+/* send_bad_gateway: 서버에 연결하지 못했을 때 클라이언트에게 502 응답 */
+void send_bad_gateway(int fd)
+{
+  static const char resp[] = "HTTP/1.0 502 Bad Gateway\r\n"
+                             "Content-length: 0\r\n\r\n";
+
+  rio_writen(fd, (void *)resp, sizeof(resp) - 1);
+}
+
+/* send_not_implemented: GET/HEAD가 아닌 요청에 501 응답 */
+void send_not_implemented(int fd)
+{
+  static const char resp[] = "HTTP/1.0 501 Not Implemented\r\n"
+                             "Content-length: 0\r\n\r\n";
+
+  rio_writen(fd, (void *)resp, sizeof(resp) - 1);
+}
+
+/* read_request: 빈 줄까지(헤더 블록 전체) 읽어서 토크나이즈, 소비한 바이트 수 반환 (오류/EOF 시 -1) */
+ssize_t read_request(int fd, char *buf, size_t size, struct phttp_request *req)
+{
+  size_t len = 0;
   ssize_t n;
-  rio_t rio;
+  int rc = PHTTP_INCOMPLETE;
 
-  Rio_readinitb(&rio, p_clientfd);           //
-  n = Rio_readnb(&rio, buf, MAX_CACHE_SIZE); // 최대 MAXLINE까지 안전하게 모두 읽음
-  Rio_writen(p_connfd, buf, n);
+  while (rc == PHTTP_INCOMPLETE)
+  {
+    if (len == size) // 헤더가 버퍼보다 큼
+      return -1;
+    if ((n = read(fd, buf + len, size - len)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0) // 헤더가 끝나기 전에 EOF
+      return -1;
+    len += n;
+    rc = phttp_parse_request(buf, len, req);
+  }
+  return rc;
+}
+
+/* send_request: 프록시 => 서버 (요청 버퍼의 슬라이스들을 iovec으로 모아 writev 한 번에 전송) */
+void send_request(int p_clientfd, struct phttp_request *req, slice *uri_ptos, char *host)
+{
+  struct iovec iov[REQ_IOV_MAX];
+  struct phttp_header *h, *host_hdr = NULL;
+  const char *end;
+  int iovcnt = 0, i;
+
+  /* 요청 라인: GET /index.html HTTP/1.0 */
+  iov_add(iov, &iovcnt, req->method.ptr, req->method.len);
+  iov_add(iov, &iovcnt, " ", 1);
+  iov_add(iov, &iovcnt, uri_ptos->ptr, uri_ptos->len);
+  iov_add(iov, &iovcnt, " ", 1);
+  iov_add(iov, &iovcnt, new_version, strlen(new_version));
+  iov_add(iov, &iovcnt, "\r\n", 2);
+
+  /* Host: 클라이언트가 보낸 값이 있으면 그대로, 없으면 URI의 host */
+  for (i = 0; i < req->num_headers; i++)
+    if (phttp_slice_eq(req->headers[i].name, "Host"))
+      host_hdr = &req->headers[i];
+  if (host_hdr)
+  {
+    iov_add(iov, &iovcnt, "Host: ", 6);
+    iov_add(iov, &iovcnt, host_hdr->value.ptr, host_hdr->value.len);
+  }
+  else
+  {
+    iov_add(iov, &iovcnt, "Host: ", 6);
+    iov_add(iov, &iovcnt, host, strlen(host));
+  }
+  iov_add(iov, &iovcnt, "\r\n", 2);
+
+  /* 고정 헤더: User-Agent, Connection, Proxy-Connection */
+  iov_add(iov, &iovcnt, user_agent_hdr, strlen(user_agent_hdr));
+  iov_add(iov, &iovcnt, "Connection: close\r\n", 19);
+  iov_add(iov, &iovcnt, "Proxy-Connection: close\r\n", 25);
+
+  /* 나머지 클라이언트 헤더는 원본 줄 그대로 전달 */
+  for (i = 0; i < req->num_headers; i++)
+  {
+    h = &req->headers[i];
+    if (is_dropped_hdr(req, &h->name))
+      continue;
+    end = h->value.ptr + h->value.len;
+    if (end[0] == '\r' && end[1] == '\n') // 값 바로 뒤가 CRLF면 한 조각으로
+      iov_add(iov, &iovcnt, h->name.ptr, end + 2 - h->name.ptr);
+    else
+    {
+      iov_add(iov, &iovcnt, h->name.ptr, end - h->name.ptr);
+      iov_add(iov, &iovcnt, "\r\n", 2);
+    }
+  }
+  iov_add(iov, &iovcnt, "\r\n", 2);
+
+  if (verbose)
+  {
+    printf("서버로 보내는 요청 헤더: \n");
+    for (i = 0; i < iovcnt; i++)
+      fwrite(iov[i].iov_base, 1, iov[i].iov_len, stdout);
+  }
+
+  rio_writev(p_clientfd, iov, iovcnt); // => 요청을 보내는 행위 자체 (실패하면 응답 읽기에서 EOF/오류로 끝남)
+}
+
+/* is_dropped_hdr: name이 프록시가 대체하는 헤더, hop-by-hop 헤더, 또는 Connection 헤더에 나열된 헤더면 1 */
+int is_dropped_hdr(struct phttp_request *req, slice *name)
+{
+  const char **d;
+  const char *p, *end, *comma;
+  slice tok;
+  int i;
+
+  for (d = dropped_hdrs; *d; d++)
+    if (phttp_slice_eq(*name, *d))
+      return 1;
+
+  /* Connection: foo, bar => foo, bar 도 hop-by-hop */
+  for (i = 0; i < req->num_headers; i++)
+  {
+    if (!phttp_slice_eq(req->headers[i].name, "Connection"))
+      continue;
+    p = req->headers[i].value.ptr;
+    end = p + req->headers[i].value.len;
+    while (p < end)
+    {
+      if (!(comma = memchr(p, ',', end - p)))
+        comma = end;
+      for (tok.ptr = p; tok.ptr < comma && (*tok.ptr == ' ' || *tok.ptr == '\t'); tok.ptr++)
+        ;
+      for (tok.len = comma - tok.ptr; tok.len && (tok.ptr[tok.len - 1] == ' ' || tok.ptr[tok.len - 1] == '\t'); tok.len--)
+        ;
+      if (tok.len == name->len && !strncasecmp(tok.ptr, name->ptr, tok.len))
+        return 1;
+      p = comma + 1;
+    }
+  }
+  return 0;
+}
+
+/* iov_add: iovec 배열 끝에 [base, base+len) 조각 추가 */
+void iov_add(struct iovec *iov, int *iovcnt, const void *base, size_t len)
+{
+  iov[*iovcnt].iov_base = (void *)base;
+  iov[*iovcnt].iov_len = len;
+  (*iovcnt)++;
+}
+
+/* handle_response: 서버 => 프록시 (hostport가 있으면 MAX_OBJECT_SIZE 이하의 응답을 캐시에 저장,
+   le에는 응답 상태 코드, 클라이언트에게 보낸 바이트 수, 첫 바이트 시각과 클라이언트에 쓰는 데 걸린 시간을 기록) */
+void handle_response(int p_connfd, int p_clientfd, char *hostport, char *path, struct plog_entry *le)
+{
+  riox_t rio;
+  char *buf, *p, *obj = NULL;
+  size_t objlen = 0;
+  ssize_t n;
+  uint64_t first, t;
+
+  /* 서버의 첫 바이트가 올 때까지는 버퍼 없이 대기 */
+  if (wait_readable(p_clientfd) < 0)
+    return;
+  first = le->mark[PLOG_FIRST_BYTE] = pm_now();
+  pm_observe(PM_FIRST_BYTE, first - le->mark[PLOG_SENT]);
+  if (!(buf = pbuf_get()))
+  {
+    send_unavailable(p_connfd);
+    le->status = 503;
+    return;
+  }
+
+  if (hostport)
+    obj = Malloc(MAX_OBJECT_SIZE);
+
+  Riox_readinitb(&rio, p_clientfd, buf, PBUF_SIZE); // read 한 번에 최대 PBUF_SIZE 바이트
+  while ((n = riox_readptrb(&rio, &p)) > 0)         // 읽은 만큼 버퍼에서 복사 없이 바로 클라이언트로 전달
+  {
+    pm_add(PM_ORIGIN_BYTES_IN, n);
+    if (!le->bytes && n > 12 && !strncmp(p, "HTTP/", 5)) // 첫 조각의 상태 줄: HTTP/1.x 200 ...
+      le->status = atoi(p + 9);
+    t = pm_now();
+    if (rio_writen(p_connfd, p, n) != n) // 클라이언트가 떠남
+    {
+      n = -1;
+      break;
+    }
+    le->write_ns += pm_now() - t; // 느린 클라이언트 때문인지 느린 서버 때문인지 구분하려고
+    PPROBE2(relay__bytes, p_connfd, n);
+    pm_add(PM_CLIENT_BYTES_OUT, n);
+    le->bytes += n;
+    if (!obj)
+      continue;
+    if (objlen + n > MAX_OBJECT_SIZE) // 너무 큰 오브젝트는 캐시하지 않음
+    {
+      Free(obj);
+      obj = NULL;
+      continue;
+    }
+    memcpy(obj + objlen, p, n);
+    objlen += n;
+  }
+  pbuf_put(buf); // 전송이 끝나면 바로 풀에 반납
+  pm_observe(PM_TRANSFER, pm_now() - first);
+
+  if (obj && n < 0) // 서버가 중간에 끊은(RST) 응답은 캐시하지 않음 (FIN으로 끊긴 건 cache_response가 길이로 걸러냄)
+  {
+    Free(obj);
+    obj = NULL;
+  }
+  if (obj)
+  {
+    cache_response(hostport, path, obj, objlen);
+    Free(obj);
+  }
+}
+
+/* cache_response: 완전한 200 응답이면 캐시에 추가 (다른 스레드가 먼저 넣었으면 그대로 둠) */
+void cache_response(char *hostport, char *path, char *obj, size_t size)
+{
+  struct phttp_response resp;
+  slice *clen, *vary;
+  int hdrlen;
+  line *lion;
+
+  if ((hdrlen = phttp_parse_response(obj, size, &resp)) < 0 || resp.status != 200)
+    return;
+  vary = phttp_find_header(resp.headers, resp.num_headers, "Vary");
+  if (vary && !phttp_slice_eq(*vary, "Accept-Encoding")) // 키(URL + Accept-Encoding)로 구분할 수 없는 응답
+    return;
+  /* 서버가 본문 중간에 FIN을 보내도 read는 0(EOF)이라 정상 종료와 구별할 수 없으므로,
+     Content-Length가 있고 받은 본문 길이와 맞는 응답만 캐시 */
+  clen = phttp_find_header(resp.headers, resp.num_headers, "Content-Length");
+  if (!clen || strtoul(clen->ptr, NULL, 10) != size - hdrlen)
+    return;
+
+  lion = make_line(hostport, path, obj, size);
+  Pthread_rwlock_wrlock(&cache_lock);
+  if (in_cache(&web_cache, hostport, path))
+  {
+    Pthread_rwlock_unlock(&cache_lock);
+    Free(lion->loc);
+    Free(lion->obj);
+    Free(lion);
+    return;
+  }
+  pm_add(PM_CACHE_EVICTIONS, add_line(&web_cache, lion));
+  Pthread_rwlock_unlock(&cache_lock);
+}
+
+/* serve_from_cache: 캐시에 있으면 복사본으로 응답하고 (le에 상태 코드와 보낸 바이트 수 기록) 1, 없으면 0 */
+int serve_from_cache(int fd, char *hostport, char *path, slice *range, struct plog_entry *le)
+{
+  line *lion;
+  char *obj;
+  size_t size;
+
+  Pthread_rwlock_rdlock(&cache_lock);
+  if (!(lion = in_cache(&web_cache, hostport, path)))
+  {
+    Pthread_rwlock_unlock(&cache_lock);
+    le->mark[PLOG_LOOKUP] = pm_now();
+    return 0;
+  }
+  size = lion->size;
+  obj = Malloc(size);
+  memcpy(obj, lion->obj, size); // 느린 클라이언트에게 보내는 동안 락을 잡고 있지 않도록 복사
+  Pthread_rwlock_unlock(&cache_lock);
+  le->mark[PLOG_LOOKUP] = pm_now();
+
+  if (verbose)
+    printf("캐시 적중: %s%s\n", hostport, path);
+  le->bytes = send_cached(fd, obj, size, range, &le->status);
+  le->write_ns = pm_now() - le->mark[PLOG_LOOKUP];
+  pm_add(PM_CLIENT_BYTES_OUT, le->bytes);
+  Free(obj);
+  return 1;
+}
+
+/* send_cached: 캐시된 200 응답을 그대로, 또는 Range가 있으면 206(하나면 그대로, 여럿이면 multipart)으로 전송,
+   보낸 바이트 수 반환 (status에는 보낸 상태 코드) */
+ssize_t send_cached(int fd, char *obj, size_t size, slice *range, int *status)
+{
+  struct phttp_response resp;
+  struct phttp_range ranges[PHTTP_MAX_RANGES];
+  struct iovec iov[RANGE_IOV_MAX];
+  char hdr[MAXLINE], parthdr[PHTTP_MAX_RANGES][256], tail[64];
+  static const char boundary[] = "proxy-byteranges-3d6f0a";
+  slice *ctype, none = {"application/octet-stream", 24};
+  size_t bodylen, len = 0;
+  ssize_t sent;
+  char *body;
+  int hdrlen, n, i, iovcnt = 0;
+
+  hdrlen = phttp_parse_response(obj, size, &resp); // 캐시에는 파싱된 적 있는 응답만 있음
+  body = obj + hdrlen;
+  bodylen = size - hdrlen;
+  if (!range || (n = phttp_parse_range(*range, bodylen, ranges, PHTTP_MAX_RANGES)) < 0)
+  {
+    *status = 200;
+    return rio_writen(fd, obj, size) == size ? size : 0; // Range 없음 (또는 잘못된 Range): 전체 응답
+  }
+  if (n == 0) // 만족할 수 있는 범위가 없음
+  {
+    *status = 416;
+    sprintf(hdr, "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                 "Content-Range: bytes */%zu\r\n"
+                 "Content-Length: 0\r\n\r\n", bodylen);
+    return rio_writen(fd, hdr, strlen(hdr)) == strlen(hdr) ? strlen(hdr) : 0;
+  }
+
+  if (!(ctype = phttp_find_header(resp.headers, resp.num_headers, "Content-Type")))
+    ctype = &none;
+  iov_add(iov, &iovcnt, hdr, 0); // 길이는 Content-Length를 계산한 뒤에 채움
+  if (n == 1)
+  {
+    len = ranges[0].last - ranges[0].first + 1;
+    sprintf(hdr, "HTTP/1.0 206 Partial Content\r\n"
+                 "Content-Type: %.*s\r\n"
+                 "Content-Range: bytes %zu-%zu/%zu\r\n"
+                 "Content-Length: %zu\r\n\r\n",
+            (int)ctype->len, ctype->ptr, ranges[0].first, ranges[0].last, bodylen, len);
+    iov_add(iov, &iovcnt, body + ranges[0].first, len);
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      snprintf(parthdr[i], sizeof(parthdr[i]),
+               "\r\n--%s\r\nContent-Type: %.*s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+               boundary, (int)ctype->len, ctype->ptr, ranges[i].first, ranges[i].last, bodylen);
+      iov_add(iov, &iovcnt, parthdr[i], strlen(parthdr[i]));
+      iov_add(iov, &iovcnt, body + ranges[i].first, ranges[i].last - ranges[i].first + 1);
+      len += strlen(parthdr[i]) + ranges[i].last - ranges[i].first + 1;
+    }
+    sprintf(tail, "\r\n--%s--\r\n", boundary);
+    iov_add(iov, &iovcnt, tail, strlen(tail));
+    len += strlen(tail);
+    sprintf(hdr, "HTTP/1.0 206 Partial Content\r\n"
+                 "Content-Type: multipart/byteranges; boundary=%s\r\n"
+                 "Content-Length: %zu\r\n\r\n",
+            boundary, len);
+  }
+  iov[0].iov_len = strlen(hdr);
+  *status = 206;
+  sent = rio_writev(fd, iov, iovcnt); // 헤더와 조각들을 writev 한 번에 (iov는 보낸 만큼 소비되므로 합계는 반환값으로)
+  return sent < 0 ? 0 : sent;
 }
 /* parse_uri: (클라이언트로부터 받은) GET 요청에서 URI 파싱, 서버로의 GET 요청을 위해 필요 */
-int parse_uri(char *uri, char *uri_ptos, char *host, char *port)
+int parse_uri(slice *uri, slice *uri_ptos, char *host, char *port)
 {
-  char *ptr = strstr(uri, "://");
-  if (!ptr)
+  slice h, p;
+
+  if (phttp_parse_uri(*uri, &h, &p, uri_ptos) < 0) // "http://" 없으면 오류
     return -1;
-  ptr += 3;
-  sscanf(ptr, "%[^:/]:%[^/]%s", host, port, uri_ptos);
+  if (h.len >= NI_MAXHOST || p.len >= NI_MAXSERV)
+    return -1;
+  /* host와 port는 getaddrinfo에 넘기므로 널 종료 문자열로 복사 */
+  memcpy(host, h.ptr, h.len);
+  host[h.len] = '\0';
+  memcpy(port, p.ptr, p.len);
+  port[p.len] = '\0';
   if (strcmp(port, "") == 0)
     strcpy(port, "80");
-  if (strcmp(uri_ptos, "") == 0)
-    strcpy(uri_ptos, "/");
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# bench-cgi.sh - Compare the three ways tiny runs dynamic content:
+#     fork+exec per request (-c fork), persistent worker processes
+#     (-c pool) and handlers loaded in-process (-c plugin). For each,
+#     fetch /cgi-bin/adder N times with C concurrent clients (one curl
+#     process) and print requests/s and the CPU time tiny (with its
+#     children and workers) spent per request.
+#
+#     usage: ./bench-cgi.sh [-n requests] [-c concurrency]
+#            (run from tiny/)
+#
+
+REQUESTS=1000
+CONCURRENCY=8
+PORT=`../free-port.sh`
+URL="http://localhost:${PORT}/cgi-bin/adder?arg1=15213&arg2=18213"
+
+while getopts "n:c:" opt; do
+    case $opt in
+        n) REQUESTS=$OPTARG ;;
+        c) CONCURRENCY=$OPTARG ;;
+        *) echo "usage: $0 [-n requests] [-c concurrency]"; exit 1 ;;
+    esac
+done
+
+make -s || exit 1
+CLK_TCK=`getconf CLK_TCK`
+
+# cpu_ticks pid... - user+system ticks of the processes and their reaped children
+cpu_ticks() {
+    cat `for p in "$@"; do echo /proc/$p/stat; done` 2> /dev/null |
+        awk '{ sub(/^.*\) /, ""); t += $12 + $13 + $14 + $15 } END { print t + 0 }'
+}
+
+urls=`mktemp`
+for i in `seq $REQUESTS`; do
+    echo "url = \"${URL}\"" >> $urls
+    echo "output = \"/dev/null\"" >> $urls
+done
+trap "kill \$tiny_pid 2> /dev/null; rm -f $urls" EXIT
+
+printf "%-8s %10s %14s\n" mode "req/s" "CPU us/req"
+for mode in fork pool plugin; do
+    ./tiny -m thread -n $CONCURRENCY -c $mode -w /cgi-bin/adder $PORT > /dev/null 2>&1 &
+    tiny_pid=$!
+    sleep 0.5
+    curl -s -o /dev/null $URL                  # start the worker pool outside the timing
+
+    workers=`pgrep -P $tiny_pid`
+    c0=`cpu_ticks $tiny_pid $workers`
+    t0=`date +%s%N`
+    curl --silent --parallel --parallel-max $CONCURRENCY --config $urls 2> /dev/null
+    t1=`date +%s%N`
+    c1=`cpu_ticks $tiny_pid $workers`
+
+    kill $tiny_pid
+    wait $tiny_pid 2> /dev/null
+    awk -v n=$REQUESTS -v ns=$((t1 - t0)) -v ticks=$((c1 - c0)) -v hz=$CLK_TCK -v m=$mode \
+        'BEGIN { printf "%-8s %10.1f %14.1f\n", m, n / (ns / 1e9), ticks / hz * 1e6 / n }'
+done
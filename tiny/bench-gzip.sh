@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# bench-gzip.sh - Measure what content encoding buys for tiny's static
+#     text files: for each file, fetch it N times with C concurrent
+#     clients (one curl process), once as is and once with
+#     "Accept-Encoding: gzip". Prints bytes on the wire per response,
+#     requests/s and MB/s of wire traffic for each.
+#
+#     usage: ./bench-gzip.sh [-n requests] [-c concurrency] [files...]
+#            (run from tiny/; default files: home.html tiny.c csapp.c)
+#
+
+REQUESTS=500
+CONCURRENCY=8
+PORT=`../free-port.sh`
+
+while getopts "n:c:" opt; do
+    case $opt in
+        n) REQUESTS=$OPTARG ;;
+        c) CONCURRENCY=$OPTARG ;;
+        *) echo "usage: $0 [-n requests] [-c concurrency] [files...]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+FILES=${@:-"home.html tiny.c csapp.c"}
+
+make -s tiny || exit 1
+./tiny -m thread -n $CONCURRENCY $PORT > /dev/null 2>&1 &
+tiny_pid=$!
+trap "kill $tiny_pid 2> /dev/null" EXIT
+sleep 0.5
+
+printf "%-12s %-9s %10s %10s %10s\n" file encoding "bytes" "req/s" "MB/s"
+for file in $FILES; do
+    for encoding in identity gzip; do
+        urls=`mktemp`
+        for i in `seq $REQUESTS`; do
+            echo "url = \"http://localhost:${PORT}/${file}\"" >> $urls
+            echo "output = \"/dev/null\"" >> $urls
+            echo "header = \"Accept-Encoding: ${encoding}\"" >> $urls
+        done
+
+        # Bytes on the wire for one response (headers + body)
+        bytes=`curl -s -o /dev/null -H "Accept-Encoding: ${encoding}" \
+               -w "%{size_header} %{size_download}" \
+               http://localhost:${PORT}/${file} | awk '{ print $1 + $2 }'`
+
+        t0=`date +%s%N`
+        curl --silent --parallel --parallel-max $CONCURRENCY --config $urls 2> /dev/null
+        t1=`date +%s%N`
+        rm -f $urls
+
+        awk -v n=$REQUESTS -v b=$bytes -v ns=$((t1 - t0)) -v f=$file -v e=$encoding \
+            'BEGIN { s = ns / 1e9;
+                     printf "%-12s %-9s %10d %10.1f %10.2f\n",
+                            f, e, b, n / s, n * b / s / 1e6 }'
+    done
+done
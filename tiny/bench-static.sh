@@ -0,0 +1,67 @@
+#!/bin/bash
+#
+# bench-static.sh - Compare tiny's static file paths: sendfile() versus
+#     mmap() + writev(). For each method and file, tiny is started in
+#     prethreaded mode and fetched N times by C concurrent clients
+#     (one curl process). Prints requests/s, MB/s and the CPU time tiny
+#     itself spent.
+#
+#     usage: ./bench-static.sh [-n requests] [-c concurrency] [files...]
+#            (run from tiny/; default files: godzilla.jpg rain.mp4)
+#
+
+REQUESTS=200
+CONCURRENCY=8
+PORT=`../free-port.sh`
+CLK_TCK=`getconf CLK_TCK`
+
+while getopts "n:c:" opt; do
+    case $opt in
+        n) REQUESTS=$OPTARG ;;
+        c) CONCURRENCY=$OPTARG ;;
+        *) echo "usage: $0 [-n requests] [-c concurrency] [files...]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+FILES=${@:-"godzilla.jpg rain.mp4"}
+
+make -s tiny || exit 1
+
+#
+# cpu_ticks - user+system clock ticks used so far by process $1
+#
+function cpu_ticks {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+printf "%-14s %-9s %10s %10s %10s\n" file method "req/s" "MB/s" "tiny cpu"
+for file in $FILES; do
+    size=`stat -c %s $file`
+    urls=`mktemp`
+    for i in `seq $REQUESTS`; do
+        echo "url = \"http://localhost:${PORT}/${file}\"" >> $urls
+        echo "output = \"/dev/null\"" >> $urls
+    done
+
+    for method in sendfile mmap; do
+        ./tiny -m thread -n $CONCURRENCY -s $method $PORT > /dev/null 2>&1 &
+        tiny_pid=$!
+        sleep 0.5
+
+        cpu0=`cpu_ticks $tiny_pid`
+        t0=`date +%s%N`
+        curl --silent --parallel --parallel-max $CONCURRENCY --config $urls 2> /dev/null
+        t1=`date +%s%N`
+        cpu1=`cpu_ticks $tiny_pid`
+
+        kill $tiny_pid
+        wait $tiny_pid 2> /dev/null
+
+        awk -v n=$REQUESTS -v sz=$size -v ns=$((t1 - t0)) \
+            -v cpu=$((cpu1 - cpu0)) -v tck=$CLK_TCK -v f=$file -v m=$method \
+            'BEGIN { s = ns / 1e9;
+                     printf "%-14s %-9s %10.1f %10.1f %9.2fs\n",
+                            f, m, n / s, n * sz / s / 1e6, cpu / tck }'
+    done
+    rm -f $urls
+done
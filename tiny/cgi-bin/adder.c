@@ -1,13 +1,56 @@
 /*
  * adder.c - a minimal CGI program that adds two numbers together
+ *     (run by tiny's worker pool, it loops over requests instead;
+ *     built with -DTINY_PLUGIN it is adder.so, which tiny loads and
+ *     calls in-process)
  */
 /* $begin adder */
 #include "csapp.h"
+#ifdef TINY_PLUGIN
+#include "plugin.h"
+#else
+#include "cgiproto.h"
+#endif
+
+int add_content(const char *query, char *content);
+
+#ifdef TINY_PLUGIN
+int tiny_plugin_abi = TINY_PLUGIN_ABI;
+
+int tiny_handle(const tiny_req_t *req, tiny_resp_t *resp) {
+  char content[MAXLINE];
+
+  resp->len = add_content(req->query, content);
+  if (resp->len <= resp->size)   /* 모자라면 tiny가 len 만큼 버퍼를 늘려 다시 부름 */
+    memcpy(resp->body, content, resp->len);
+  return 0;
+}
+#else
+void adder(FILE *out);
+
 int main(void) {
-  char *buf, *p;
-  char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE];
+  if (cgi_worker())   /* tiny 워커 풀에서 실행됨: 요청마다 adder 반복 */
+    return cgi_serve(adder);
+  adder(stdout);
+  fflush(stdout);
+  exit(0);
+}
+
+void adder(FILE *out) {
+  char content[MAXLINE];
+  int len = add_content(getenv("QUERY_STRING"), content);
+
+  fprintf(out, "Content-length: %d\r\n", len);
+  fprintf(out, "Content-type: text/html\r\n\r\n");
+  fprintf(out, "%s", content);
+}
+#endif
+
+/* 페이지 본문을 content에 만들고 길이를 돌려줌 (CGI, 워커, 플러그인 공용) */
+int add_content(const char *buf, char *content) {
+  char arg1[MAXLINE] = "", arg2[MAXLINE] = "", *p;
   int n1=0, n2=0;
-  if ((buf = getenv("QUERY_STRING")) != NULL) {
+  if (buf != NULL) {
     // p = strchr(buf, '&');
     sscanf(buf, "arg1=%[^&]&arg2=%s", arg1, arg2);
     // *p = '\0';
@@ -16,15 +59,10 @@ int main(void) {
     n1 = atoi(arg1);
     n2 = atoi(arg2);
   }
-  sprintf(content, "QUERY_STRING=%s", buf);
-  sprintf(content, "Welcome to add.com: ");
-  sprintf(content, "%sThe addition portal.\r\n<p>", content);
-  sprintf(content, "%sThe answer is: %d + %d = %d\r\n<p>", content, n1, n2, n1+n2);
-  sprintf(content, "%sThanks for visiting!\r\n", content);
-  printf("Connection: close\r\n");
-  printf("Content-length: %d\r\n", (int)strlen(content));
-  printf("Content-type: text/html\r\n\r\n");
-  printf("%s", content);
-  fflush(stdout);
-  exit(0);
-}
\ No newline at end of file
+  p = content;
+  p += sprintf(p, "Welcome to add.com: ");
+  p += sprintf(p, "The addition portal.\r\n<p>");
+  p += sprintf(p, "The answer is: %d + %d = %d\r\n<p>", n1, n2, n1+n2);
+  p += sprintf(p, "Thanks for visiting!\r\n");
+  return p - content;
+}
@@ -0,0 +1,225 @@
+/*
+ * cgipool.c - pools of persistent CGI worker processes for tiny
+ *
+ * Only programs named with cgipool_add (tiny -w) get a pool: tiny
+ * never runs a program just to find out whether it is a worker. The
+ * first request for one starts nworkers copies of it, each connected
+ * to tiny by a Unix socket pair on its fd 0 and told by CGI_WORKER_ENV
+ * to loop over requests (see cgiproto.c). A request borrows an idle
+ * worker from the pool's sbuf (waiting if all are busy), sends it the
+ * CGI variables and collects its output frames for tiny to send, so a
+ * dynamic request costs a socket round trip instead of a fork and
+ * exec. A worker that dies is replaced. If a program doesn't say it is
+ * ready within CGI_READY_SECS, it is spawned per request instead.
+ */
+#include "cgipool.h"
+#include "cgiproto.h"
+#include "cgispawn.h"
+
+static cgipool_t pools[MAXPOOLS];
+static int npools;                               // cgipool_add 이후로는 읽기만 함
+static int workers_per_pool = CGI_WORKERS;
+
+/*
+ * spawn - start worker i of pool
+ */
+static void spawn(cgipool_t *pool, int i)
+{
+    int sv[2], rc;
+    pid_t pid = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+	unix_error("socketpair error");
+    /* 요청은 fd 0 으로 (FastCGI 관례), tiny의 다른 fd는 물려받지 않음 */
+    if ((rc = spawn_program(&pid, pool->filename, sv[1], STDIN_FILENO, environ)) != 0)
+	fprintf(stderr, "cgipool: %s: %s\n", pool->filename, strerror(rc));
+    close(sv[1]);                                // 실패했으면 ready 프레임 대신 EOF
+    pool->fds[i] = sv[0];
+    pool->pids[i] = pid;
+}
+
+/*
+ * spawn_ready - start worker i and wait up to CGI_READY_SECS for its
+ *     ready frame; returns 0, or -1 (worker reaped) if it doesn't send one
+ */
+static int spawn_ready(cgipool_t *pool, int i)
+{
+    struct timeval tmo = {CGI_READY_SECS, 0}, none = {0, 0};
+    int type;
+    size_t len;
+
+    spawn(pool, i);
+    setsockopt(pool->fds[i], SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo)); // stdin을 읽는 일반 CGI면 영영 대기
+    if (cgi_recv_hdr(pool->fds[i], &type, &len) < 0 || type != CGI_END || len ||
+	setsockopt(pool->fds[i], SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none)) < 0) {
+	close(pool->fds[i]);
+	if (pool->pids[i] > 0) {                 // 시작도 못 했으면 pid 가 -1 (kill(-1) 금지)
+	    kill(pool->pids[i], SIGKILL);
+	    waitpid(pool->pids[i], NULL, 0);
+	}
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * respawn - replace worker i after it died or failed; returns 0, or
+ *     -1 if the program no longer starts as a worker
+ */
+static int respawn(cgipool_t *pool, int i)
+{
+    fprintf(stderr, "cgipool: worker %d of %s failed, restarting\n",
+	    (int)pool->pids[i], pool->filename);
+    close(pool->fds[i]);
+    if (pool->pids[i] > 0) {
+	kill(pool->pids[i], SIGKILL);
+	waitpid(pool->pids[i], NULL, 0);
+    }
+    if (spawn_ready(pool, i) < 0) {
+	pthread_mutex_lock(&pool->lock);
+	pool->plain = 1;
+	pthread_mutex_unlock(&pool->lock);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * get_pool - find the pool for filename; returns NULL if it has none
+ */
+static cgipool_t *get_pool(char *filename)
+{
+    int i;
+
+    for (i = 0; i < npools; i++)
+	if (!strcmp(pools[i].filename, filename))
+	    return &pools[i];
+    return NULL;
+}
+
+/*
+ * start_pool - start pool's workers on its first request; returns 1 if
+ *     the program isn't a worker (fork it per request), else 0. Only
+ *     the pool's own lock is held while they start, so a slow program
+ *     holds up requests for itself, not for every CGI program.
+ */
+static int start_pool(cgipool_t *pool)
+{
+    int i, plain;
+
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->started) {
+	for (i = 0; i < pool->nworkers && !pool->plain; i++) {
+	    if (spawn_ready(pool, i) < 0)
+		pool->plain = 1;                 // 워커 프로토콜을 모르는 CGI 프로그램
+	    else
+		sbuf_insert(&pool->idle, i);
+	}
+	pool->started = 1;
+    }
+    plain = pool->plain;
+    pthread_mutex_unlock(&pool->lock);
+    return plain;
+}
+
+/*
+ * cgipool_init - set the number of workers per program; call before
+ *     cgipool_add and before any threads are started
+ */
+void cgipool_init(int nworkers)
+{
+    if (nworkers > 0)
+	workers_per_pool = nworkers;
+    setenv(CGI_WORKER_ENV, "1", 1);              // 워커들이 물려받는 환경 (fork 후에 바꾸지 않음)
+}
+
+/*
+ * cgipool_add - give the CGI program at path (as in the URI,
+ *     "/cgi-bin/adder") a pool of workers, started by its first request;
+ *     call before any threads are started. Returns 0, or -1 if there's
+ *     no room for another pool.
+ */
+int cgipool_add(char *path)
+{
+    cgipool_t *pool;
+
+    if (npools == MAXPOOLS || strlen(path) + 2 > MAXLINE)
+	return -1;
+    pool = &pools[npools++];
+    sprintf(pool->filename, ".%s", path);        // tiny가 URI에서 만드는 파일 이름
+    pool->nworkers = workers_per_pool;
+    pool->fds = Calloc(pool->nworkers, sizeof(int));
+    pool->pids = Calloc(pool->nworkers, sizeof(pid_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    sbuf_init(&pool->idle, pool->nworkers);
+    return 0;
+}
+
+/*
+ * cgipool_run - run a CGI request on a pooled worker and collect its
+ *     output (header lines, blank line, body) in a Malloc'd buffer for
+ *     the caller to send with a Content-length. Returns 0 with *outp
+ *     and *lenp set, -1 on failure, or CGIPOOL_FORK if the program
+ *     has no pool or didn't start as a worker. Only a worker found dead
+ *     before it got the request is replaced and the request retried; a
+ *     request that a worker fails on is not tried on another.
+ */
+int cgipool_run(char *filename, char *cgiargs, char **outp, size_t *lenp)
+{
+    cgipool_t *pool;
+    char params[MAXLINE], *out = NULL;
+    size_t len, total = 0, size = 0;
+    int i, type, plen, tries = 0, toobig = 0;
+
+    if (!(pool = get_pool(filename)) || start_pool(pool))
+	return CGIPOOL_FORK;
+    plen = snprintf(params, sizeof(params), "QUERY_STRING=%s", cgiargs) + 1;
+    if (plen > (int)sizeof(params))              // 요청 탓: 워커는 건드리지 않음
+	return -1;
+ retry:
+    i = sbuf_remove(&pool->idle);                // 놀고 있는 워커 빌리기 (모두 바쁘면 대기)
+    if (cgi_send(pool->fds[i], CGI_PARAMS, params, plen) < 0)
+	goto failed;                             // 놀다가 죽은 워커: 새 워커로 다시
+
+    while (1) {
+	if (cgi_recv_hdr(pool->fds[i], &type, &len) < 0)
+	    goto broken;
+	if (type == CGI_END)
+	    break;
+	if (type != CGI_STDOUT || toobig || total + len > CGI_MAXOUTPUT) {
+	    toobig |= (type == CGI_STDOUT);      // 너무 크면 버리면서 워커 응답은 끝까지 읽음
+	    if (cgi_skip(pool->fds[i], len) < 0)
+		goto broken;
+	    continue;
+	}
+	if (total + len > size) {                // 출력 버퍼 늘리기
+	    size = (total + len) * 2;
+	    out = Realloc(out, size);
+	}
+	if (rio_readn(pool->fds[i], out + total, len) != (ssize_t)len)
+	    goto broken;
+	total += len;
+    }
+    sbuf_insert(&pool->idle, i);
+    if (toobig || total == 0) {                  // 출력이 없으면 헤더도 없으니 오류로
+	Free(out);
+	return -1;
+    }
+    *outp = out;
+    *lenp = total;
+    return 0;
+
+ broken:                                     // 이 요청을 처리하다 깨짐: 워커는 바꾸되 요청은 다시 보내지 않음
+    Free(out);
+    if (respawn(pool, i) == 0)
+	sbuf_insert(&pool->idle, i);
+    return -1;
+
+ failed:
+    if (respawn(pool, i) < 0)
+	return -1;
+    sbuf_insert(&pool->idle, i);
+    if (tries++ < pool->nworkers)                // 아직 요청을 보내지도 못했으니 다른(새) 워커로 다시
+	goto retry;
+    return -1;
+}
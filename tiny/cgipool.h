@@ -0,0 +1,34 @@
+/*
+ * cgipool.h - pools of persistent CGI worker processes for tiny
+ */
+#ifndef __CGIPOOL_H__
+#define __CGIPOOL_H__
+
+#include "csapp.h"
+#include "sbuf.h"
+
+#define CGI_WORKERS 4     /* Default workers per CGI program */
+#define MAXPOOLS 16       /* Most CGI programs with a pool */
+#define CGI_READY_SECS 5  /* How long a new worker has to say it is ready */
+
+/* $begin cgipool_t */
+typedef struct {
+    char filename[MAXLINE];    /* Program the workers run */
+    int nworkers;
+    int *fds;                  /* fds[i]: socket to worker i */
+    pid_t *pids;               /* pids[i]: its process id */
+    int started;               /* Workers started (by the first request) */
+    int plain;                 /* Didn't start as a worker: fork it per request */
+    pthread_mutex_t lock;      /* Protects started and plain */
+    sbuf_t idle;               /* Indices of idle workers */
+} cgipool_t;
+/* $end cgipool_t */
+
+/* cgipool_run returns this for programs that don't run as workers */
+#define CGIPOOL_FORK 1
+
+void cgipool_init(int nworkers);
+int cgipool_add(char *path);
+int cgipool_run(char *filename, char *cgiargs, char **outp, size_t *lenp);
+
+#endif /* __CGIPOOL_H__ */
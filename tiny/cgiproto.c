@@ -0,0 +1,129 @@
+/*
+ * cgiproto.c - framed protocol between tiny and its CGI worker processes
+ *
+ * tiny keeps a few long-lived processes per CGI program and talks to
+ * each over a Unix socket on the worker's fd 0 (as FastCGI does). A
+ * program that wants to be run this way calls cgi_serve() when
+ * cgi_worker() says so, and otherwise behaves as a plain CGI program.
+ */
+#include "cgiproto.h"
+
+/*
+ * cgi_send - send one frame; returns 0, or -1 on error
+ */
+int cgi_send(int fd, int type, void *buf, size_t len)
+{
+    cgi_hdr_t hdr;
+    struct iovec iov[2];
+
+    hdr.version = CGI_VERSION;
+    hdr.type = type;
+    hdr.reserved = 0;
+    hdr.len = htonl(len);
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+    return rio_writev(fd, iov, 2) < 0 ? -1 : 0;   // 헤더와 내용을 writev 한 번에
+}
+
+/*
+ * cgi_recv_hdr - read a frame header; the caller then reads *len bytes
+ *     of payload. Returns 0, or -1 on EOF, error or a bad frame.
+ */
+int cgi_recv_hdr(int fd, int *type, size_t *len)
+{
+    cgi_hdr_t hdr;
+
+    if (rio_readn(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+	return -1;
+    *type = hdr.type;
+    *len = ntohl(hdr.len);
+    if (hdr.version != CGI_VERSION || *len > CGI_MAXFRAME)
+	return -1;
+    return 0;
+}
+
+/*
+ * cgi_skip - read and drop len bytes of payload; returns 0 or -1
+ */
+int cgi_skip(int fd, size_t len)
+{
+    char buf[MAXBUF];
+    size_t n;
+
+    while (len > 0) {
+	n = len < MAXBUF ? len : MAXBUF;
+	if (rio_readn(fd, buf, n) != (ssize_t)n)
+	    return -1;
+	len -= n;
+    }
+    return 0;
+}
+
+/*
+ * cgi_worker - was this program started by tiny's worker pool?
+ */
+int cgi_worker(void)
+{
+    return getenv(CGI_WORKER_ENV) != NULL;
+}
+
+/*
+ * cgi_serve - worker loop: for each request on fd 0, set its CGI
+ *     variables, run handler with its output captured, and send that
+ *     back. Returns when tiny closes the socket.
+ */
+int cgi_serve(void (*handler)(FILE *out))
+{
+    char *params, *p, *eq, *out;
+    size_t len, outlen, off, n;
+    int type, rc;
+    FILE *fp;
+
+    if (cgi_send(STDIN_FILENO, CGI_END, NULL, 0) < 0)  // 준비 완료 알림
+	return -1;
+    while (cgi_recv_hdr(STDIN_FILENO, &type, &len) == 0) {
+	params = Malloc(len + 1);
+	if (rio_readn(STDIN_FILENO, params, len) != (ssize_t)len) {
+	    Free(params);
+	    break;
+	}
+	params[len] = '\0';
+	if (type != CGI_PARAMS) {
+	    Free(params);
+	    continue;
+	}
+
+	/* NAME=value\0NAME=value\0... -> environment */
+	for (p = params; p < params + len; p += strlen(p) + 1)
+	    if ((eq = strchr(p, '='))) {
+		*eq = '\0';
+		setenv(p, eq + 1, 1);
+		*eq = '=';
+	    }
+
+	fp = open_memstream(&out, &outlen);      // 핸들러 출력을 메모리에 모아서 프레임으로
+	handler(fp);
+	fclose(fp);
+	for (off = 0, rc = 0; rc == 0 && off < outlen; off += n) {
+	    n = outlen - off < CGI_MAXFRAME ? outlen - off : CGI_MAXFRAME; // tiny가 받는 프레임 크기까지만
+	    rc = cgi_send(STDIN_FILENO, CGI_STDOUT, out + off, n);
+	}
+	if (rc < 0 || cgi_send(STDIN_FILENO, CGI_END, NULL, 0) < 0) {
+	    free(out);
+	    Free(params);
+	    break;
+	}
+	free(out);
+
+	/* 다음 요청에 이전 요청의 변수가 남지 않도록 */
+	for (p = params; p < params + len; p += strlen(p) + 1)
+	    if ((eq = strchr(p, '='))) {
+		*eq = '\0';
+		unsetenv(p);
+	    }
+	Free(params);
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * cgiproto.h - framed protocol between tiny and its CGI worker processes
+ */
+#ifndef __CGIPROTO_H__
+#define __CGIPROTO_H__
+
+#include "csapp.h"
+
+/*
+ * Every message is a frame: an 8-byte header (version, type, two
+ * reserved bytes, payload length in network byte order) followed by
+ * the payload. A worker first announces itself with an empty CGI_END
+ * frame. A request is then one CGI_PARAMS frame; the worker answers
+ * with any number of CGI_STDOUT frames (each at most CGI_MAXFRAME)
+ * and one CGI_END frame.
+ */
+#define CGI_VERSION 1
+#define CGI_PARAMS  1   /* tiny -> worker: "NAME=value\0" CGI variables */
+#define CGI_STDOUT  2   /* worker -> tiny: a chunk of the program's output */
+#define CGI_END     3   /* worker -> tiny: the response is complete */
+
+#define CGI_MAXFRAME (1 << 20)   /* Largest payload accepted */
+#define CGI_MAXOUTPUT (8 << 20)  /* Most output tiny collects for one response */
+#define CGI_WORKER_ENV "TINY_CGI_WORKER" /* Set when run by tiny's pool */
+
+/* $begin cgi_hdr_t */
+typedef struct {
+    unsigned char version;     /* CGI_VERSION */
+    unsigned char type;        /* CGI_PARAMS, CGI_STDOUT or CGI_END */
+    unsigned short reserved;
+    unsigned int len;          /* Payload bytes (network byte order) */
+} cgi_hdr_t;
+/* $end cgi_hdr_t */
+
+/* Both sides */
+int cgi_send(int fd, int type, void *buf, size_t len);
+int cgi_recv_hdr(int fd, int *type, size_t *len);
+int cgi_skip(int fd, size_t len);
+
+/* Worker side: the CGI program's request loop */
+int cgi_worker(void);
+int cgi_serve(void (*handler)(FILE *out));
+
+#endif /* __CGIPROTO_H__ */
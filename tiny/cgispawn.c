@@ -0,0 +1,205 @@
+/*
+ * cgispawn.c - start CGI programs per request without fork()
+ *
+ * fork() copies the page tables of all of tiny (every worker thread's
+ * stack, the file cache) only for the child to exec right away, and
+ * the book's Waitpid() then holds the serving thread until the program
+ * is done. Here a program is started with posix_spawn(), which glibc
+ * implements with vfork semantics; its stdout is the client socket
+ * (a file action) and it inherits no other descriptor. The serving
+ * thread returns at once: the program owns the connection from then on
+ * and the client sees EOF when it exits. On a keep-alive connection
+ * the output goes through a pipe instead (cgispawn_capture), so tiny
+ * can send it with a Content-length and keep the connection. A reaper thread watches every
+ * running program through a pidfd and reaps exactly that child, so
+ * tiny's other children (the CGI worker pools) are never waited for by
+ * mistake. A semaphore caps how many programs run at once.
+ */
+#include "cgispawn.h"
+#include "cgiproto.h"
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#define REAP_EVENTS 64
+
+/* glibc 2.34+ declares this only under _GNU_SOURCE, whose gai_error()
+   clashes with csapp.h's */
+int posix_spawn_file_actions_addclosefrom_np(posix_spawn_file_actions_t *actions,
+					     int from);
+
+static sem_t running;          /* Free slots for CGI programs */
+static int reapfd = -1;        /* epoll set of running programs' pidfds */
+
+/*
+ * reaper - reap each program as its pidfd becomes readable (it exited)
+ *     and give its slot back
+ */
+static void *reaper(void *vargp)
+{
+    struct epoll_event events[REAP_EVENTS];
+    int i, n;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	if ((n = epoll_wait(reapfd, events, REAP_EVENTS, -1)) < 0)
+	    continue;                            // EINTR
+	for (i = 0; i < n; i++) {
+	    pid_t pid = (pid_t)(events[i].data.u64 & 0xffffffff);
+	    int pidfd = (int)(events[i].data.u64 >> 32);
+
+	    waitpid(pid, NULL, 0);               // 이미 끝난 그 자식만 정리
+	    close(pidfd);                        // epoll 에서도 같이 빠짐
+	    V(&running);
+	}
+    }
+    return NULL;
+}
+
+/*
+ * cgispawn_init - set the limit on programs running at once (0 for the
+ *     default) and start the reaper
+ */
+void cgispawn_init(int maxrunning)
+{
+    pthread_t tid;
+
+    Sem_init(&running, 0, maxrunning > 0 ? maxrunning : CGI_MAXRUNNING);
+    if ((reapfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	fprintf(stderr, "cgispawn: epoll_create1: %s; waiting for CGI programs\n",
+		strerror(errno));
+    else
+	Pthread_create(&tid, NULL, reaper, NULL);
+}
+
+/*
+ * make_env - tiny's environment for a CGI program: QUERY_STRING set to
+ *     cgiargs (setenv() in a threaded server would race), and without
+ *     the variable that tells a program to act as a pool worker
+ */
+static char **make_env(char *cgiargs)
+{
+    char **envp, **ep;
+    size_t n = 0, wlen = strlen(CGI_WORKER_ENV);
+
+    for (ep = environ; *ep; ep++)
+	n++;
+    envp = Malloc((n + 2) * sizeof(char *));
+    envp[0] = Malloc(strlen(cgiargs) + 14);      // 직접 만든 건 envp[0] 하나 (free 할 것)
+    sprintf(envp[0], "QUERY_STRING=%s", cgiargs);
+    n = 1;
+    for (ep = environ; *ep; ep++)
+	if (strncmp(*ep, "QUERY_STRING=", 13) &&
+	    !(strncmp(*ep, CGI_WORKER_ENV, wlen) == 0 && (*ep)[wlen] == '='))
+	    envp[n++] = *ep;
+    envp[n] = NULL;
+    return envp;
+}
+
+/*
+ * spawn_program - posix_spawn filename with fd as its descriptor
+ *     target, no other descriptors above 2, and the signal mask and
+ *     dispositions a fresh process would have. Returns 0 or an errno.
+ */
+int spawn_program(pid_t *pid, char *filename, int fd, int target, char **envp)
+{
+    char *argv[] = { filename, NULL };
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+    int rc;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, target);
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);   // 다른 클라이언트 연결은 물려주지 않음
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);    // tiny가 막아 둔 SIGUSR1 풀기
+    sigaddset(&sigs, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigs); // tiny가 무시하는 SIGPIPE 되돌리기
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    rc = posix_spawn(pid, filename, &actions, &attr, argv, envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return rc;
+}
+
+/*
+ * cgispawn - run filename with stdout on fd (the client's connection,
+ *     or a pipe), waiting first if the limit is reached. Returns 0 once
+ *     it is running, or -1 with errno set if it couldn't be started.
+ */
+int cgispawn(int fd, char *filename, char *cgiargs)
+{
+    char **envp;
+    struct epoll_event ev;
+    pid_t pid;
+    int rc, pidfd;
+
+    P(&running);                                 // 동시에 도는 CGI 수 제한
+    envp = make_env(cgiargs);
+    rc = spawn_program(&pid, filename, fd, STDOUT_FILENO, envp);
+    Free(envp[0]);
+    Free(envp);
+    if (rc != 0) {
+	V(&running);
+	errno = rc;
+	return -1;
+    }
+
+    /* 끝나면 리퍼 스레드가 정리: 이 스레드는 바로 다음 요청으로 */
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)pidfd << 32) | (uint32_t)pid;
+    if (pidfd < 0 || reapfd < 0 || epoll_ctl(reapfd, EPOLL_CTL_ADD, pidfd, &ev) < 0) {
+	waitpid(pid, NULL, 0);                   // pidfd 가 없는 커널: 책처럼 기다림
+	if (pidfd >= 0)
+	    close(pidfd);
+	V(&running);
+    }
+    return 0;
+}
+
+/*
+ * cgispawn_capture - run filename with stdout on a pipe and collect
+ *     what it writes (at most CGI_MAXOUTPUT bytes) in a Malloc'd
+ *     buffer, so the response can get a Content-length. Returns 0 with
+ *     *outp and *lenp set, or -1.
+ */
+int cgispawn_capture(char *filename, char *cgiargs, char **outp, size_t *lenp)
+{
+    int pfd[2];
+    char *out = NULL;
+    size_t len = 0, size = 0;
+    ssize_t n;
+
+    if (pipe(pfd) < 0)                           // 다른 자식들은 closefrom 으로 안 물려받음
+	return -1;
+    if (cgispawn(pfd[1], filename, cgiargs) < 0) {
+	close(pfd[0]);
+	close(pfd[1]);
+	return -1;
+    }
+    close(pfd[1]);                               // 이제 쓰는 쪽은 자식뿐: 끝나면 EOF
+    while (1) {
+	if (len == size) {
+	    if (size >= CGI_MAXOUTPUT)
+		break;                           // 너무 큼: 읽기를 멈추면 자식은 SIGPIPE
+	    size = size ? size * 2 : MAXBUF;
+	    out = Realloc(out, size);
+	}
+	if ((n = read(pfd[0], out + len, size - len)) < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	len += n;
+    }
+    close(pfd[0]);
+    if (n != 0 || len == 0) {                    // 오류, 너무 큰 출력, 또는 출력 없음
+	Free(out);
+	return -1;
+    }
+    *outp = out;
+    *lenp = len;
+    return 0;
+}
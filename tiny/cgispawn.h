@@ -0,0 +1,16 @@
+/*
+ * cgispawn.h - start CGI programs per request without fork()
+ */
+#ifndef __CGISPAWN_H__
+#define __CGISPAWN_H__
+
+#include "csapp.h"
+
+#define CGI_MAXRUNNING 32  /* Default limit on CGI programs running at once */
+
+void cgispawn_init(int maxrunning);
+int cgispawn(int fd, char *filename, char *cgiargs);
+int cgispawn_capture(char *filename, char *cgiargs, char **outp, size_t *lenp);
+int spawn_program(pid_t *pid, char *filename, int fd, int target, char **envp);
+
+#endif /* __CGISPAWN_H__ */
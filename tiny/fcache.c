@@ -0,0 +1,540 @@
+/*
+ * fcache.c - open-file, metadata and small-response cache for tiny
+ *
+ * Keeps up to FCACHE_MAX static files open, each with its stat() data,
+ * MIME type and prebuilt response header, in an LRU list indexed by a
+ * hash table. A hit costs no filesystem syscalls at all: a cached file
+ * is re-stat'ed at most once every FCACHE_REVALIDATE_MS, and replaced
+ * if its inode, mode, size or mtime changed. Entries are reference
+ * counted, so a file that is evicted or replaced stays open until the
+ * last request sending it is done.
+ *
+ * Files no bigger than FCACHE_MEM_OBJECT also get their complete
+ * response (header block + body) read into one buffer, so serving them
+ * is a single write. Compressed responses (gzip, deflate) are kept the
+ * same way, built on first request from a precompressed foo.gz sibling
+ * or with zlib; since an entry is replaced when its file changes, they
+ * are cached by path and mtime. All these buffers share a byte budget;
+ * going over it evicts the least recently used entries holding any.
+ */
+#include "csapp.h"
+#include "fcache.h"
+#include <zlib.h>
+
+#define FCACHE_BUCKETS 1024
+
+static fentry_t *table[FCACHE_BUCKETS];
+static fentry_t *lru_head, *lru_tail;
+static int nentries;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static filetype_fn *get_type;
+static header_fn *build_header;
+
+static size_t mem_budget;   /* Most bytes of in-memory responses */
+static size_t mem_used;     /* Bytes of responses in cached entries */
+static int mem_entries;     /* Cached entries holding a response */
+
+static char *encoding_names[NENCODINGS] = { "gzip", "deflate" };
+
+/* Counters, protected by lock */
+static unsigned long hits, misses, revalidations, replaced, evictions;
+static unsigned long mem_hits, mem_evictions;
+static unsigned long zhits, zprecompressed, zcompressed;
+static unsigned long long zbytes_in, zbytes_out;
+
+static unsigned int hash(char *s)
+{
+    unsigned int h = 5381;
+
+    while (*s)
+	h = h * 33 + (unsigned char)*s++;
+    return h % FCACHE_BUCKETS;
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * same_file - is the file behind st unchanged (contents and permissions)
+ *     since it was stat'ed as was?
+ */
+static int same_file(struct stat *was, struct stat *st)
+{
+    return st->st_dev == was->st_dev && st->st_ino == was->st_ino &&
+	st->st_mode == was->st_mode && st->st_size == was->st_size &&
+	st->st_mtim.tv_sec == was->st_mtim.tv_sec &&
+	st->st_mtim.tv_nsec == was->st_mtim.tv_nsec;
+}
+
+/*
+ * gz_name - put filename's foo.gz sibling in gzname (MAXLINE bytes);
+ *     returns -1 if it doesn't fit
+ */
+static int gz_name(char *filename, char *gzname)
+{
+    if (strlen(filename) + 4 > MAXLINE)
+	return -1;
+    sprintf(gzname, "%s.gz", filename);
+    return 0;
+}
+
+/*
+ * same_gz - is filename's foo.gz sibling as it was (gzst zeroed: absent)
+ *     when the entry's gzip response was built?
+ */
+static int same_gz(char *filename, struct stat *gzst)
+{
+    char gzname[MAXLINE];
+    struct stat st;
+
+    if (gz_name(filename, gzname) < 0 || stat(gzname, &st) < 0)
+	return gzst->st_ino == 0;
+    return same_file(gzst, &st);
+}
+
+/*
+ * lru_unlink, lru_push - take fe out of / put fe at the front of the
+ *     LRU list (lock held)
+ */
+static void lru_unlink(fentry_t *fe)
+{
+    if (fe->prev) fe->prev->next = fe->next;
+    else lru_head = fe->next;
+    if (fe->next) fe->next->prev = fe->prev;
+    else lru_tail = fe->prev;
+    fe->prev = fe->next = NULL;
+}
+
+static void lru_push(fentry_t *fe)
+{
+    fe->prev = NULL;
+    fe->next = lru_head;
+    if (lru_head) lru_head->prev = fe;
+    lru_head = fe;
+    if (!lru_tail) lru_tail = fe;
+}
+
+static fentry_t *lookup(char *filename, unsigned int h)
+{
+    fentry_t *fe;
+
+    for (fe = table[h]; fe; fe = fe->hnext)
+	if (!strcmp(fe->filename, filename))
+	    return fe;
+    return NULL;
+}
+
+static void free_entry(fentry_t *fe)
+{
+    int enc;
+
+    close(fe->fd);
+    for (enc = 0; enc < NENCODINGS; enc++)
+	free(fe->zresp[enc]);
+    free(fe->resp);
+    Free(fe->hdr);
+    Free(fe->filename);
+    Free(fe);
+}
+
+/*
+ * unlink_entry - remove fe from the table and the LRU list and mark it
+ *     dead; frees it now if no request is using it (lock held)
+ */
+static void unlink_entry(fentry_t *fe)
+{
+    fentry_t **pp;
+
+    for (pp = &table[hash(fe->filename)]; *pp; pp = &(*pp)->hnext)
+	if (*pp == fe) {
+	    *pp = fe->hnext;
+	    break;
+	}
+    lru_unlink(fe);
+    nentries--;
+    if (fe->memlen) {               /* Counted out now, freed with fe */
+	mem_used -= fe->memlen;
+	mem_entries--;
+    }
+    fe->dead = 1;
+    if (fe->refcnt == 0)
+	free_entry(fe);
+}
+
+/*
+ * make_room - evict the least recently used entries holding responses
+ *     in memory, other than keep, until the budget is met (lock held)
+ */
+static void make_room(fentry_t *keep)
+{
+    fentry_t *fe;
+
+    while (mem_used > mem_budget) {                   // 예산 초과: 메모리에 올린 것 중 가장 오래 안 쓴 것부터
+	for (fe = lru_tail; fe && (fe == keep || !fe->memlen); fe = fe->prev)
+	    ;
+	if (!fe)
+	    return;
+	evictions++;
+	mem_evictions++;
+	unlink_entry(fe);
+    }
+}
+
+/*
+ * read_all - read exactly n bytes of fd from offset 0 into buf;
+ *     returns 0, or -1 if the file won't read (or shrank)
+ */
+static int read_all(int fd, char *buf, size_t n)
+{
+    size_t done = 0;
+    ssize_t rc;
+
+    while (done < n) {
+	if ((rc = pread(fd, buf + done, n - done, done)) <= 0) {
+	    if (rc < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	done += rc;
+    }
+    return 0;
+}
+
+/*
+ * read_response - read fe's whole file after its header into fe->resp;
+ *     leaves resp NULL if the file isn't small enough or won't read
+ */
+static void read_response(fentry_t *fe)
+{
+    size_t size = fe->st.st_size;
+
+    if (size > FCACHE_MEM_OBJECT || fe->hdrlen + size > mem_budget)
+	return;
+    if (!(fe->resp = malloc(fe->hdrlen + size)))
+	return;
+    memcpy(fe->resp, fe->hdr, fe->hdrlen);
+    if (read_all(fe->fd, fe->resp + fe->hdrlen, size) < 0) {
+	free(fe->resp);                           // 읽는 도중 파일이 바뀜: 메모리에는 안 올림
+	fe->resp = NULL;
+	return;
+    }
+    fe->resplen = fe->memlen = fe->hdrlen + size;
+}
+
+/*
+ * encoded_response - prepend fe's header for a body of len bytes in
+ *     coding enc; returns the malloc'd response (body is freed)
+ */
+static char *encoded_response(fentry_t *fe, int enc, char *body, size_t len,
+			      size_t *lenp)
+{
+    char hdr[MAXBUF], *resp;
+    size_t hdrlen;
+
+    build_header(fe, encoding_names[enc], len, hdr);
+    hdrlen = strlen(hdr);
+    if ((resp = malloc(hdrlen + len))) {
+	memcpy(resp, hdr, hdrlen);
+	memcpy(resp + hdrlen, body, len);
+	*lenp = hdrlen + len;
+    }
+    free(body);
+    return resp;
+}
+
+/*
+ * read_precompressed - load fe's foo.gz sibling as its gzip response,
+ *     filling in st with its stat() (zeroed if there is none); returns
+ *     NULL if there isn't a readable, non-empty one at least as new as
+ *     foo that fits the budget
+ */
+static char *read_precompressed(fentry_t *fe, struct stat *st, size_t *lenp)
+{
+    char gzname[MAXLINE], *body;
+    int fd;
+
+    memset(st, 0, sizeof(*st));
+    if (gz_name(fe->filename, gzname) < 0)
+	return NULL;
+    if ((fd = open(gzname, O_RDONLY, 0)) < 0)
+	return NULL;
+    body = NULL;
+    if (fstat(fd, st) == 0 && S_ISREG(st->st_mode) &&
+	st->st_size > 0 && st->st_mtime >= fe->st.st_mtime && // 비었거나 foo보다 오래된 foo.gz는 쓰지 않음
+	st->st_size + MAXBUF <= mem_budget &&
+	(body = malloc(st->st_size)) && read_all(fd, body, st->st_size) < 0) {
+	free(body);
+	body = NULL;
+    }
+    close(fd);
+    return body ? encoded_response(fe, ENC_GZIP, body, st->st_size, lenp) : NULL;
+}
+
+/*
+ * compress_file - compress fe's file with zlib into a gzip or deflate
+ *     (zlib-wrapped) response, setting *zlenp to the compressed body
+ *     size; returns NULL if it can't
+ */
+static char *compress_file(fentry_t *fe, int enc, size_t *lenp, size_t *zlenp)
+{
+    size_t size = fe->st.st_size, bound;
+    char *src, *body = NULL;
+    z_stream zs;
+
+    if (size > FCACHE_ENCODE_MAX || size + MAXBUF > mem_budget)
+	return NULL;
+    if (fe->resp)                                     // 메모리에 있으면 그걸, 없으면 파일을 매핑해서 압축
+	src = fe->resp + fe->hdrlen;
+    else if (size == 0 ||
+	     (src = mmap(0, size, PROT_READ, MAP_PRIVATE, fe->fd, 0)) == MAP_FAILED)
+	return NULL;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+		     enc == ENC_GZIP ? MAX_WBITS + 16 : MAX_WBITS,
+		     8, Z_DEFAULT_STRATEGY) == Z_OK) {
+	bound = deflateBound(&zs, size);
+	if ((body = malloc(bound))) {
+	    zs.next_in = (Bytef *)src;
+	    zs.avail_in = size;
+	    zs.next_out = (Bytef *)body;
+	    zs.avail_out = bound;
+	    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+		free(body);
+		body = NULL;
+	    }
+	}
+	deflateEnd(&zs);
+    }
+    if (!fe->resp)
+	munmap(src, size);
+    *zlenp = zs.total_out;
+    return body ? encoded_response(fe, enc, body, zs.total_out, lenp) : NULL;
+}
+
+/*
+ * open_entry - open filename and build a new entry for it; returns NULL
+ *     with errno set if it can't be opened (EACCES if it isn't a
+ *     regular file readable by its owner)
+ */
+static fentry_t *open_entry(char *filename)
+{
+    int fd;
+    fentry_t *fe;
+    char buf[MAXBUF];
+
+    if ((fd = open(filename, O_RDONLY, 0)) < 0)
+	return NULL;
+    fe = Calloc(1, sizeof(fentry_t));
+    fe->fd = fd;
+    if (fstat(fd, &fe->st) < 0 ||
+	!S_ISREG(fe->st.st_mode) || !(S_IRUSR & fe->st.st_mode)) {
+	close(fd);
+	Free(fe);
+	errno = EACCES;
+	return NULL;
+    }
+    fe->filename = strdup(filename);
+    get_type(filename, fe->filetype);
+    build_header(fe, NULL, fe->st.st_size, buf);
+    fe->hdr = strdup(buf);
+    fe->hdrlen = strlen(buf);
+    read_response(fe);
+    fe->checked = now_ms();
+    fe->refcnt = 1;
+    return fe;
+}
+
+/*
+ * fcache_init - set the callbacks that fill in an entry's MIME type and
+ *     header block, and the byte budget for in-memory responses (0 keeps
+ *     none in memory)
+ */
+void fcache_init(filetype_fn *filetype, header_fn *header, size_t budget)
+{
+    get_type = filetype;
+    build_header = header;
+    mem_budget = budget;
+}
+
+/*
+ * fcache_get - return the cache entry for filename, opening the file if
+ *     it isn't cached (or changed on disk); returns NULL with errno set
+ *     if it can't be served. Release the entry with fcache_put.
+ */
+fentry_t *fcache_get(char *filename)
+{
+    unsigned int h = hash(filename);
+    fentry_t *fe, *old;
+    struct stat st, gzst;
+    int gzcheck;
+    long now = now_ms();
+
+    pthread_mutex_lock(&lock);
+    if ((fe = lookup(filename, h))) {
+	fe->refcnt++;
+	lru_unlink(fe);
+	lru_push(fe);
+	if (now - fe->checked < FCACHE_REVALIDATE_MS) {
+	    hits++;                                   // 재검사 주기 안: syscall 없이 적중
+	    if (fe->resp)
+		mem_hits++;
+	    pthread_mutex_unlock(&lock);
+	    return fe;
+	}
+	fe->checked = now;                            // 다른 스레드는 재검사 없이 계속 적중
+	revalidations++;
+	gzcheck = fe->zresp[ENC_GZIP] || fe->znone[ENC_GZIP];
+	gzst = fe->gzst;
+	pthread_mutex_unlock(&lock);
+
+	if (stat(filename, &st) == 0 && same_file(&fe->st, &st) &&
+	    (!gzcheck || same_gz(filename, &gzst))) { // gzip 응답을 만들었으면 foo.gz도 재검사
+	    pthread_mutex_lock(&lock);
+	    hits++;
+	    if (fe->resp)
+		mem_hits++;
+	    pthread_mutex_unlock(&lock);
+	    return fe;
+	}
+	/* Changed or gone: drop it and open it again */
+	pthread_mutex_lock(&lock);
+	replaced++;
+	if (!fe->dead)
+	    unlink_entry(fe);
+	pthread_mutex_unlock(&lock);
+	fcache_put(fe);
+    }
+    else
+	pthread_mutex_unlock(&lock);
+
+    if (!(fe = open_entry(filename)))
+	return NULL;
+
+    pthread_mutex_lock(&lock);
+    misses++;
+    if ((old = lookup(filename, h)))                  // 다른 스레드가 먼저 넣었으면 교체
+	unlink_entry(old);
+    fe->hnext = table[h];
+    table[h] = fe;
+    lru_push(fe);
+    nentries++;
+    if (fe->memlen) {
+	mem_used += fe->memlen;
+	mem_entries++;
+    }
+    while (nentries > FCACHE_MAX) {                   // 가장 오래 안 쓴 파일부터 닫기
+	evictions++;
+	unlink_entry(lru_tail);
+    }
+    make_room(fe);
+    pthread_mutex_unlock(&lock);
+    return fe;
+}
+
+/*
+ * fcache_put - release an entry returned by fcache_get
+ */
+void fcache_put(fentry_t *fe)
+{
+    int done;
+
+    pthread_mutex_lock(&lock);
+    done = (--fe->refcnt == 0 && fe->dead);
+    pthread_mutex_unlock(&lock);
+    if (done)
+	free_entry(fe);
+}
+
+/*
+ * fcache_encoded - return fe's whole response in content coding enc
+ *     (ENC_GZIP, ENC_DEFLATE) and its length, building it the first
+ *     time from a precompressed sibling (gzip only) or, if compress is
+ *     set, with zlib; returns NULL if there is none. The response stays
+ *     valid until fe is released with fcache_put.
+ */
+char *fcache_encoded(fentry_t *fe, int enc, int compress, size_t *lenp)
+{
+    char *resp;
+    size_t len, zlen = 0;
+    struct stat gzst = {0};
+    int precompressed = 0;
+
+    pthread_mutex_lock(&lock);
+    if ((resp = fe->zresp[enc]) || fe->znone[enc]) {
+	*lenp = fe->zresplen[enc];
+	if (resp)
+	    zhits++;
+	pthread_mutex_unlock(&lock);
+	return resp;
+    }
+    pthread_mutex_unlock(&lock);
+
+    /* First request for this coding: build it outside the lock */
+    if (enc == ENC_GZIP && (resp = read_precompressed(fe, &gzst, &len)))
+	precompressed = 1;
+    else if (compress)
+	resp = compress_file(fe, enc, &len, &zlen);
+
+    pthread_mutex_lock(&lock);
+    if (fe->zresp[enc] || fe->znone[enc]) {           // 다른 스레드가 먼저 만들었음
+	free(resp);
+	resp = fe->zresp[enc];
+    }
+    else if (!resp) {
+	fe->znone[enc] = 1;                           // 다시 시도하지 않음 (파일이 바뀌면 새 항목)
+	if (enc == ENC_GZIP)
+	    fe->gzst = gzst;
+    }
+    else {
+	if (enc == ENC_GZIP)
+	    fe->gzst = gzst;
+	fe->zresp[enc] = resp;
+	fe->zresplen[enc] = len;
+	if (precompressed)
+	    zprecompressed++;
+	else {
+	    zcompressed++;
+	    zbytes_in += fe->st.st_size;
+	    zbytes_out += zlen;
+	}
+	if (!fe->dead) {
+	    if (!fe->memlen)
+		mem_entries++;
+	    mem_used += len;
+	    fe->memlen += len;
+	    make_room(fe);
+	}
+    }
+    *lenp = fe->zresplen[enc];
+    pthread_mutex_unlock(&lock);
+    return resp;
+}
+
+/*
+ * fcache_print_stats - print cache counters to fp
+ */
+void fcache_print_stats(FILE *fp)
+{
+    unsigned long lookups;
+
+    pthread_mutex_lock(&lock);
+    lookups = hits + misses;
+    fprintf(fp, "fcache: %d files open, %lu hits, %lu misses, "
+	    "%lu revalidations (%lu replaced), %lu evictions\n",
+	    nentries, hits, misses, revalidations, replaced, evictions);
+    fprintf(fp, "fcache: %d files with responses in memory, %zu of %zu bytes, "
+	    "%lu memory hits (%.1f%% of lookups), %lu evicted for space\n",
+	    mem_entries, mem_used, mem_budget, mem_hits,
+	    lookups ? 100.0 * mem_hits / lookups : 0.0, mem_evictions);
+    fprintf(fp, "fcache: %lu compressed hits, %lu precompressed loaded, "
+	    "%lu compressed (%llu -> %llu bytes)\n",
+	    zhits, zprecompressed, zcompressed, zbytes_in, zbytes_out);
+    pthread_mutex_unlock(&lock);
+}
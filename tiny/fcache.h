@@ -0,0 +1,56 @@
+/*
+ * fcache.h - open-file, metadata and small-response cache for tiny
+ */
+#ifndef __FCACHE_H__
+#define __FCACHE_H__
+
+#include "csapp.h"
+
+#define FCACHE_MAX 256            /* Most files kept open */
+#define FCACHE_REVALIDATE_MS 1000 /* Re-stat a cached file at most this often */
+#define MAXTYPE 64                /* Longest MIME type */
+#define FCACHE_MEM_OBJECT (64 * 1024)        /* Largest file kept in memory */
+#define FCACHE_MEM_BUDGET (16 * 1024 * 1024) /* Default bytes of responses in memory */
+#define FCACHE_ENCODE_MAX (1024 * 1024)      /* Largest file compressed on the fly */
+
+/* Content codings an entry can keep a compressed response for */
+#define ENC_GZIP    0
+#define ENC_DEFLATE 1
+#define NENCODINGS  2
+
+/* $begin fentry_t */
+typedef struct fentry {
+    char *filename;            /* Key: path as passed to fcache_get */
+    int fd;                    /* Open read-only descriptor */
+    struct stat st;            /* stat() of the file when it was opened */
+    char filetype[MAXTYPE];    /* MIME type */
+    char *hdr;                 /* Prebuilt 200 response header block */
+    size_t hdrlen;             /* strlen(hdr) */
+    char *resp;                /* Whole response (hdr + body), or NULL */
+    size_t resplen;            /* Bytes in resp */
+    char *zresp[NENCODINGS];   /* Whole compressed responses, or NULL */
+    size_t zresplen[NENCODINGS]; /* Bytes in zresp */
+    char znone[NENCODINGS];    /* Tried: no compressed response possible */
+    struct stat gzst;          /* stat() of foo.gz when zresp[ENC_GZIP] was
+                                  built (zeroed if there was none) */
+    size_t memlen;             /* Bytes of resp + zresp held in memory */
+    long checked;              /* Last revalidation (monotonic ms) */
+    int refcnt;                /* Requests currently using this entry */
+    int dead;                  /* Replaced or evicted; free at refcnt 0 */
+    struct fentry *hnext;      /* Hash chain */
+    struct fentry *prev, *next; /* LRU list, most recent first */
+} fentry_t;
+/* $end fentry_t */
+
+/* Callbacks tiny supplies: MIME type of a file, and its header block
+ * for a body of len bytes in the given content coding (NULL: none) */
+typedef void filetype_fn(char *filename, char *filetype);
+typedef void header_fn(fentry_t *fe, char *encoding, size_t len, char *buf);
+
+void fcache_init(filetype_fn *filetype, header_fn *header, size_t mem_budget);
+fentry_t *fcache_get(char *filename);
+void fcache_put(fentry_t *fe);
+char *fcache_encoded(fentry_t *fe, int enc, int compress, size_t *lenp);
+void fcache_print_stats(FILE *fp);
+
+#endif /* __FCACHE_H__ */
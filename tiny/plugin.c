@@ -0,0 +1,107 @@
+/*
+ * plugin.c - load tiny's in-process handler plugins
+ *
+ * At startup every foo.so in the plugin directory is dlopen()ed and,
+ * if it exports a matching tiny_plugin_abi and a tiny_handle function,
+ * registered under prefix + "foo" in a hash table. The table is only
+ * written before the server starts, so lookups take no lock.
+ */
+#include "csapp.h"
+#include "plugin.h"
+#include <dirent.h>
+#include <dlfcn.h>
+
+#define PLUGIN_BUCKETS 64
+
+typedef struct route {
+    char *path;                /* Key: URL path, e.g. "/cgi-bin/adder" */
+    tiny_handler_fn *handler;
+    struct route *next;
+} route_t;
+
+static route_t *routes[PLUGIN_BUCKETS];
+
+static unsigned int hash(char *s)
+{
+    unsigned int h = 5381;
+
+    while (*s)
+	h = h * 33 + (unsigned char)*s++;
+    return h % PLUGIN_BUCKETS;
+}
+
+/*
+ * load - dlopen one plugin and register it under path; returns 0, or
+ *     -1 (with a message) if it isn't a usable plugin
+ */
+static int load(char *file, char *path)
+{
+    void *dl;
+    int *abi;
+    tiny_handler_fn *handler;
+    route_t *r;
+    unsigned int h;
+
+    if (!(dl = dlopen(file, RTLD_NOW | RTLD_LOCAL))) {
+	fprintf(stderr, "plugin: %s\n", dlerror());
+	return -1;
+    }
+    abi = dlsym(dl, "tiny_plugin_abi");
+    handler = (tiny_handler_fn *)dlsym(dl, "tiny_handle");
+    if (!abi || *abi != TINY_PLUGIN_ABI || !handler) {
+	fprintf(stderr, "plugin: %s: not a tiny plugin (ABI %d)\n",
+		file, TINY_PLUGIN_ABI);
+	dlclose(dl);
+	return -1;
+    }
+    r = Malloc(sizeof(route_t));
+    r->path = strdup(path);
+    r->handler = handler;
+    h = hash(path);
+    r->next = routes[h];
+    routes[h] = r;
+    fprintf(stderr, "plugin: %s -> %s\n", path, file);
+    return 0;
+}
+
+/*
+ * plugin_init - load every *.so in dir, each answering prefix + its
+ *     name without ".so"; returns how many were loaded
+ */
+int plugin_init(char *dir, char *prefix)
+{
+    DIR *dp;
+    struct dirent *de;
+    char file[MAXLINE], path[MAXLINE];
+    size_t len;
+    int n = 0;
+
+    if (!(dp = opendir(dir)))
+	return 0;
+    while ((de = readdir(dp))) {
+	len = strlen(de->d_name);
+	if (len <= 3 || strcmp(de->d_name + len - 3, ".so"))
+	    continue;
+	if (snprintf(file, MAXLINE, "%s/%s", dir, de->d_name) >= MAXLINE ||
+	    snprintf(path, MAXLINE, "%s%.*s", prefix, (int)len - 3,
+		     de->d_name) >= MAXLINE)
+	    continue;
+	if (load(file, path) == 0)
+	    n++;
+    }
+    closedir(dp);
+    return n;
+}
+
+/*
+ * plugin_find - return the handler registered for path, or NULL
+ */
+tiny_handler_fn *plugin_find(char *path)
+{
+    route_t *r;
+
+    for (r = routes[hash(path)]; r; r = r->next)
+	if (!strcmp(r->path, path))
+	    return r->handler;
+    return NULL;
+}
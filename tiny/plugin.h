@@ -0,0 +1,50 @@
+/*
+ * plugin.h - in-process handler plugins for tiny
+ *
+ * A plugin is a shared object in cgi-bin/ (foo.so answers /cgi-bin/foo)
+ * that tiny dlopen()s at startup. It exports two symbols:
+ *
+ *     int tiny_plugin_abi = TINY_PLUGIN_ABI;
+ *     int tiny_handle(const tiny_req_t *req, tiny_resp_t *resp);
+ *
+ * tiny_handle is called from any of tiny's threads, so it must be
+ * thread safe. It writes the response body into resp->body (resp->size
+ * bytes) and sets resp->len; if the body needs more room it sets len to
+ * what it needs and tiny calls it again with a buffer that big. It may
+ * set status and content_type (defaults: 200, "text/html"). It returns
+ * 0, or -1 for tiny to answer 500.
+ *
+ * This header is all a plugin needs; it doesn't link against tiny.
+ */
+#ifndef __PLUGIN_H__
+#define __PLUGIN_H__
+
+#include <stddef.h>
+
+#define TINY_PLUGIN_ABI 1
+
+/* $begin tiny_req_t */
+typedef struct {
+    const char *method;        /* "GET" */
+    const char *path;          /* "/cgi-bin/adder" */
+    const char *query;         /* What followed '?' in the URI, or "" */
+} tiny_req_t;
+/* $end tiny_req_t */
+
+/* $begin tiny_resp_t */
+typedef struct {
+    int status;                /* HTTP status code */
+    char content_type[64];     /* Content-type of the body */
+    char *body;                /* Buffer for the body (tiny's) */
+    size_t size;               /* Bytes available in body */
+    size_t len;                /* Bytes of body written (or needed) */
+} tiny_resp_t;
+/* $end tiny_resp_t */
+
+typedef int tiny_handler_fn(const tiny_req_t *req, tiny_resp_t *resp);
+
+/* tiny's side: load cgi-bin/ *.so and find the handler for a path */
+int plugin_init(char *dir, char *prefix);
+tiny_handler_fn *plugin_find(char *path);
+
+#endif /* __PLUGIN_H__ */
@@ -1,94 +1,582 @@
 /* $begin tinymain */
 /*
- * tiny.c - A simple, iterative HTTP/1.0 Web server that uses the 
- *     GET method to serve static and dynamic content.
+ * tiny.c - A simple HTTP/1.1 Web server that uses the GET method to
+ *     serve static and dynamic content. It runs iteratively (the
+ *     book's version), with a prethreaded pool of workers, or with an
+ *     epoll loop that hands connections to the workers once their
+ *     request has arrived; see usage(). Connections are kept open
+ *     between requests (every response has a Content-length) until
+ *     the client closes them or they sit idle for the idle timeout.
  */
 #include "csapp.h"
+#include "sbuf.h"
+#include "fcache.h"
+#include "cgipool.h"
+#include "cgispawn.h"
+#include "plugin.h"
+#include "phttp.h"             /* Range parsing, shared with the proxy */
+#include <sys/epoll.h>
+#include <poll.h>
 
-void doit(int fd);
-void read_requesthdrs(rio_t *rp);
+#define SBUFSIZE 1024          /* Connections queued for the workers */
+#define THREADS_PER_CPU 4      /* Default workers per online CPU */
+#define MAXEVENTS 256          /* epoll events handled per wakeup */
+#define MAXRANGES 16           /* Most byte ranges served in one response */
+#define IDLE_TIMEOUT 5         /* Default seconds an idle connection is kept */
+#define IDLE_POLL_MS 50        /* How often a worker holding one checks the queue */
+#define MAXACCEPT 64           /* Most accepting threads (-a) */
+
+/* Request headers tiny acts on (the rest are only logged, with -v) */
+typedef struct {
+    char range[MAXLINE];       /* Range value, or "" */
+    int encodings;             /* Accept-Encoding: bit (1 << ENC_*) per coding */
+    int conn_close;            /* Connection: close */
+    int conn_keepalive;        /* Connection: keep-alive */
+    int has_body;              /* Content-length or Transfer-encoding (not read) */
+    int http10;                /* Request line said HTTP/1.0 (or less) */
+    int keepalive;             /* Keep the connection after this response */
+} reqhdrs_t;
+
+/* A connection waiting in the epoll set (-m epoll), indexed by fd */
+typedef struct {
+    riox_t rio;                /* Read state; no buffer while parked */
+    int fresh;                 /* Accepted, nothing read yet */
+    int epfd;                  /* epoll set of the loop that accepted it */
+    time_t idle_until;         /* Closed if still parked then (0: not parked) */
+} conn_t;
+
+int doit(int fd, riox_t *rp);
+void read_requesthdrs(riox_t *rp, reqhdrs_t *hdrs);
+int has_token(char *value, char *token);
+int parse_accept_encoding(char *value);
 int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize);
+int serve_static(int fd, fentry_t *fe, reqhdrs_t *hdrs);
+int serve_ranges(int fd, fentry_t *fe, struct phttp_range *ranges, int n, char *tail);
+int send_range(int fd, fentry_t *fe, off_t first, size_t len);
+int serve_encoded(int fd, fentry_t *fe, int encodings, char *tail);
+char *end_headers(reqhdrs_t *hdrs);
+int compressible(char *filetype);
+int sendfile_unavailable(off_t sent);
 void get_filetype(char *filename, char *filetype);
-void serve_dynamic(int fd, char *filename, char *cgiargs);
+void static_header(fentry_t *fe, char *encoding, size_t len, char *buf);
+void serve_dynamic(int fd, char *filename, char *cgiargs, reqhdrs_t *hdrs);
+int send_cgi_output(int fd, char *out, size_t len, reqhdrs_t *hdrs);
+void serve_plugin(int fd, tiny_handler_fn *handler, char *method,
+		  char *path, char *cgiargs, reqhdrs_t *hdrs);
+char *reason_phrase(int status);
 void clienterror(int fd, char *cause, char *errnum, 
 		 char *shortmsg, char *longmsg);
+int accept_conn(int listenfd);
+void serve_iterative(int listenfd);
+void serve_threads(int *listenfds, int nlisten, int nthreads);
+void *accept_thread(void *vargp);
+void serve_epoll(int *listenfds, int nlisten, int nthreads);
+void *epoll_thread(void *vargp);
+void epoll_loop(int listenfd);
+void serve_conn(int fd, int listenfd);
+int next_request(int fd, riox_t *rp, int listenfd);
+void serve_ready(int fd, char *buf, size_t size);
+void park_conn(int fd);
+void close_idle(int epfd, time_t now);
+void start_workers(int nthreads);
+void *worker(void *vargp);
+void usage(char *prog);
+void start_stats_thread(void);
+void *stats_thread(void *vargp);
+
+sbuf_t sbuf; /* Connections waiting for a worker */
+int use_sendfile = 1; /* Static bodies go out with sendfile (else mmap) */
+size_t mem_budget = FCACHE_MEM_BUDGET; /* Bytes of small responses kept in memory */
+int use_cgipool = 1;  /* CGI requests go to persistent workers (else fork) */
+int use_plugins = 1;  /* cgi-bin/foo.so handles /cgi-bin/foo in-process */
+int idle_timeout = IDLE_TIMEOUT; /* Seconds to keep an idle connection (0 = close) */
+int verbose = 0;      /* -v: print connections, request and response headers */
+conn_t *conns;        /* -m epoll: state of each connection, by fd */
+int maxconn;          /* -m epoll: highest fd in conns so far */
+pthread_mutex_t conns_lock = PTHREAD_MUTEX_INITIALIZER;
 
 int main(int argc, char **argv) 
 {
-    int listenfd, connfd;
+    int listenfds[MAXACCEPT], nlisten = 1, i, c;
+    int nthreads = 0, cgiworkers = 0, maxcgi = 0, nworkerprogs = 0;
+    char *workerprogs[MAXPOOLS];
+    char *mode = "iter";
+
+    /* Check command line args */
+    while ((c = getopt(argc, argv, "m:n:a:s:b:c:p:w:l:k:v")) != -1) {
+	switch (c) {
+	case 'm': mode = optarg; break;
+	case 'n': nthreads = atoi(optarg); break;
+	case 'a': nlisten = atoi(optarg); break;
+	case 's': use_sendfile = strcmp(optarg, "mmap") != 0; break;
+	case 'b': mem_budget = strtoul(optarg, NULL, 0); break;
+	case 'c':
+	    use_plugins = !strcmp(optarg, "plugin");
+	    use_cgipool = strcmp(optarg, "fork") != 0;
+	    break;
+	case 'p': cgiworkers = atoi(optarg); break;
+	case 'w':
+	    if (nworkerprogs == MAXPOOLS)
+		usage(argv[0]);
+	    workerprogs[nworkerprogs++] = optarg;
+	    break;
+	case 'l': maxcgi = atoi(optarg); break;
+	case 'k': idle_timeout = atoi(optarg); break;
+	case 'v': verbose = 1; break;
+	default: usage(argv[0]);
+	}
+    }
+    if (optind != argc - 1 || nlisten < 1 || nlisten > MAXACCEPT ||
+	(nlisten > 1 && !strcmp(mode, "iter")))
+	usage(argv[0]);
+    if (nthreads <= 0)
+	nthreads = THREADS_PER_CPU * sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* A client that goes away mid-response must not kill the server */
+    Signal(SIGPIPE, SIG_IGN);
+    start_stats_thread();
+    fcache_init(get_filetype, static_header, mem_budget);
+    cgispawn_init(maxcgi);
+    if (use_cgipool) {
+	cgipool_init(cgiworkers);
+	for (i = 0; i < nworkerprogs; i++)       // -p 다음에 풀을 만들도록 여기서
+	    if (cgipool_add(workerprogs[i]) < 0)
+		usage(argv[0]);
+    }
+    if (use_plugins)
+	plugin_init("./cgi-bin", "/cgi-bin/");
+
+    if (nlisten == 1)
+	listenfds[0] = Open_listenfd(argv[optind]);
+    else                                     // 스레드마다 자기 수신 소켓: 커널이 새 연결을 나눠 줌
+	for (i = 0; i < nlisten; i++)
+	    listenfds[i] = Open_listenfd_reuseport(argv[optind]);
+    if (!strcmp(mode, "iter"))
+	serve_iterative(listenfds[0]);
+    else if (!strcmp(mode, "thread"))
+	serve_threads(listenfds, nlisten, nthreads);
+    else if (!strcmp(mode, "epoll"))
+	serve_epoll(listenfds, nlisten, nthreads);
+    else
+	usage(argv[0]);
+    return 0;
+}
+
+void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-m iter|thread|epoll] [-n nthreads] [-a naccept] [-s sendfile|mmap]\n"
+	    "       [-b bytes] [-c plugin|pool|fork] [-p nworkers] [-w /cgi-bin/prog]... [-l maxcgi]\n"
+	    "       [-k secs] [-v] <port>\n", prog);
+    fprintf(stderr, "  -m iter    one connection at a time (default)\n");
+    fprintf(stderr, "  -m thread  prethreaded pool of nthreads workers\n");
+    fprintf(stderr, "  -m epoll   epoll loop feeding ready connections to the pool\n");
+    fprintf(stderr, "  -a         with -m thread or epoll: naccept threads (or epoll loops), each\n"
+	    "             accepting on its own SO_REUSEPORT socket (default 1, max %d)\n", MAXACCEPT);
+    fprintf(stderr, "  -s         how static file bodies are sent (default sendfile)\n");
+    fprintf(stderr, "  -b         memory for whole responses of small files (default %d, 0 = off)\n",
+	    FCACHE_MEM_BUDGET);
+    fprintf(stderr, "  -c plugin  cgi-bin/foo.so runs in-process for /cgi-bin/foo, other\n"
+	    "             CGI programs as with -c pool (default)\n");
+    fprintf(stderr, "  -c pool    CGI programs named with -w run as nworkers persistent\n"
+	    "             processes each, others are started per request\n");
+    fprintf(stderr, "  -c fork    start a CGI program per request\n");
+    fprintf(stderr, "  -p         workers per CGI program (default %d)\n", CGI_WORKERS);
+    fprintf(stderr, "  -w         a CGI program that speaks the worker protocol (see cgiproto.h;\n"
+	    "             repeat for more, at most %d)\n", MAXPOOLS);
+    fprintf(stderr, "  -l         most CGI programs started per request running at once (default %d)\n",
+	    CGI_MAXRUNNING);
+    fprintf(stderr, "  -k         seconds an idle connection is kept open (default %d, 0 = close\n"
+	    "             after each response)\n", IDLE_TIMEOUT);
+    fprintf(stderr, "  -v         print each connection and its request and response headers\n"
+	    "             (stdout is written under a lock; off by default)\n");
+    exit(1);
+}
+
+/*
+ * accept_conn - accept a connection (and, with -v, log where it came from)
+ */
+int accept_conn(int listenfd)
+{
+    int connfd;
     char hostname[MAXLINE], port[MAXLINE];
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;
 
-    /* Check command line args */
-    if (argc != 2) {
-	fprintf(stderr, "usage: %s <port>\n", argv[0]);
-	exit(1);
+    clientlen = sizeof(clientaddr);
+    connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
+    if (verbose) {                           // 이름 조회(역방향 DNS)도 출력할 때만
+	Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
+		    port, MAXLINE, 0);
+	printf("Accepted connection from (%s, %s)\n", hostname, port);
+    }
+    if (idle_timeout > 0) {                  // 다음 요청을 idle_timeout 초까지만 기다림
+	struct timeval tv = { idle_timeout, 0 };
+	setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     }
+    return connfd;
+}
+
+/*
+ * serve_iterative - the book's loop: one connection at a time
+ */
+void serve_iterative(int listenfd)
+{
+    int connfd;
 
-    listenfd = Open_listenfd(argv[1]);
     while (1) {
-	clientlen = sizeof(clientaddr);
-	connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-        Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
-                    port, MAXLINE, 0);
-        printf("Accepted connection from (%s, %s)\n", hostname, port);
-	doit(connfd);                                             // doit
+	connfd = accept_conn(listenfd);
+	serve_conn(connfd, listenfd);                             // 연결이 끝날 때까지 doit
 	Close(connfd);                                            // 연결 닫고 다음 요청 기다리기
     }
 }
+
+/*
+ * serve_threads - prethreaded: the main thread accepts and queues
+ *     connections; nthreads workers take them off the queue. With
+ *     several listening sockets (-a), each gets its own accepting
+ *     thread, the main thread taking the first.
+ */
+void serve_threads(int *listenfds, int nlisten, int nthreads)
+{
+    int i;
+    pthread_t tid;
+
+    start_workers(nthreads);
+    for (i = 1; i < nlisten; i++)
+	Pthread_create(&tid, NULL, accept_thread, &listenfds[i]);
+    accept_thread(&listenfds[0]);
+}
+
+/*
+ * accept_thread - accept on one listening socket and queue the
+ *     connections for the workers
+ */
+void *accept_thread(void *vargp)
+{
+    int listenfd = *(int *)vargp;
+
+    while (1)
+	sbuf_insert(&sbuf, accept_conn(listenfd));                // 빈 워커가 가져가도록 큐에 넣기
+    return NULL;
+}
+
+/*
+ * serve_epoll - an epoll loop per listening socket (one, or one per
+ *     -a thread, the main thread running the first) feeds the one
+ *     worker pool
+ */
+void serve_epoll(int *listenfds, int nlisten, int nthreads)
+{
+    int i;
+    pthread_t tid;
+
+    conns = Calloc(sysconf(_SC_OPEN_MAX), sizeof(conn_t));
+    start_workers(nthreads);
+    for (i = 1; i < nlisten; i++)
+	Pthread_create(&tid, NULL, epoll_thread, &listenfds[i]);
+    epoll_loop(listenfds[0]);
+}
+
+void *epoll_thread(void *vargp)
+{
+    Pthread_detach(pthread_self());
+    epoll_loop(*(int *)vargp);
+    return NULL;
+}
+
+/*
+ * epoll_loop - wait on the listening socket and on every connection
+ *     accepted from it that has no request yet (new or kept alive),
+ *     in an epoll set of this loop's own; a connection goes to the
+ *     workers only once its request is readable, so idle or slow
+ *     clients never hold a worker. Idle connections are closed once a
+ *     second when their time is up.
+ */
+void epoll_loop(int listenfd)
+{
+    int i, n, fd, epfd;
+    struct epoll_event ev, events[MAXEVENTS];
+    time_t swept = time(NULL);
+
+    if ((epfd = epoll_create1(0)) < 0)
+	unix_error("epoll_create1 error");
+    ev.events = EPOLLIN;
+    ev.data.fd = listenfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+	unix_error("epoll_ctl error");
+
+    while (1) {
+	if ((n = epoll_wait(epfd, events, MAXEVENTS, 1000)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("epoll_wait error");
+	}
+	for (i = 0; i < n; i++) {
+	    fd = events[i].data.fd;
+	    if (fd == listenfd) {                                 // 새 연결: 요청이 올 때까지 epoll이 대기
+		fd = accept_conn(listenfd);
+		conns[fd].fresh = 1;
+		conns[fd].epfd = epfd;                            // 요청이 끝나면 워커가 이 루프로 돌려보냄
+		park_conn(fd);
+	    }
+	    else {                                                // 요청 도착: epoll에서 빼고 워커에게
+		pthread_mutex_lock(&conns_lock);
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+		conns[fd].idle_until = 0;
+		pthread_mutex_unlock(&conns_lock);
+		sbuf_insert(&sbuf, fd);
+	    }
+	}
+	if (idle_timeout > 0 && time(NULL) != swept)              // 1초에 한 번 오래 쉰 연결 정리
+	    close_idle(epfd, swept = time(NULL));
+    }
+}
+
+/*
+ * park_conn - put a connection (without a read buffer) back in the
+ *     epoll set of its loop to wait for its next request
+ */
+void park_conn(int fd)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    pthread_mutex_lock(&conns_lock);
+    conns[fd].idle_until = time(NULL) + idle_timeout;
+    if (fd > maxconn)
+	maxconn = fd;
+    if (epoll_ctl(conns[fd].epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	unix_error("epoll_ctl error");
+    pthread_mutex_unlock(&conns_lock);
+}
+
+/*
+ * close_idle - close the connections parked in epfd whose idle time is up
+ */
+void close_idle(int epfd, time_t now)
+{
+    int fd;
+
+    pthread_mutex_lock(&conns_lock);
+    for (fd = 0; fd <= maxconn; fd++)
+	if (conns[fd].idle_until && conns[fd].idle_until <= now &&
+	    conns[fd].epfd == epfd) {
+	    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	    conns[fd].idle_until = 0;
+	    Close(fd);
+	}
+    pthread_mutex_unlock(&conns_lock);
+}
+
+/*
+ * serve_conn - serve requests on a connection until the client closes
+ *     it, asks to, or goes quiet; pipelined requests are answered in
+ *     order from the read buffer. listenfd is the listening socket in
+ *     the iterative loop, -1 for a pool worker.
+ */
+void serve_conn(int fd, int listenfd)
+{
+    riox_t rio;
+    char buf[MAXBUF];
+
+    riox_readinitb(&rio, fd, buf, sizeof(buf));
+    while (doit(fd, &rio) && next_request(fd, &rio, listenfd))
+	;
+}
+
+/*
+ * next_request - wait up to the idle timeout for another request on a
+ *     kept-alive connection; returns 1 when one is there, or 0 to close
+ *     the connection: it stayed idle, or other connections are waiting
+ *     (a new one on listenfd, or queued for the pool) for the thread
+ *     this idle one holds
+ */
+int next_request(int fd, riox_t *rp, int listenfd)
+{
+    struct pollfd pfd[2];
+    int waited = 0, n;
+
+    if (rp->rio_cnt > 0)                                      // 파이프라인된 요청이 이미 버퍼에
+	return 1;
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = listenfd;
+    pfd[1].events = POLLIN;
+    while (waited < idle_timeout * 1000) {
+	if ((n = poll(pfd, listenfd >= 0 ? 2 : 1, IDLE_POLL_MS)) < 0 && errno != EINTR)
+	    return 0;
+	if (n > 0 && pfd[0].revents)
+	    return 1;
+	if (listenfd >= 0 ? n > 0 && pfd[1].revents : sbuf_waiting(&sbuf) > 0)
+	    return 0;                                         // 쉬는 연결이 스레드를 잡고 있지 않게 양보
+	waited += IDLE_POLL_MS;
+    }
+    return 0;
+}
+
+/*
+ * serve_ready - -m epoll: serve the requests that have arrived on a
+ *     connection with the worker's buffer, then park it again without
+ *     one (or close it)
+ */
+void serve_ready(int fd, char *buf, size_t size)
+{
+    conn_t *c = &conns[fd];
+    int keep;
+
+    if (c->fresh) {
+	riox_readinitb(&c->rio, fd, buf, size);
+	c->fresh = 0;
+    }
+    else
+	riox_setbuf(&c->rio, buf, size);                      // 쉬는 동안 떼어 둔 버퍼 대신 이 워커의 버퍼
+    do
+	keep = doit(fd, &c->rio);
+    while (keep && c->rio.rio_cnt > 0);                       // 파이프라인으로 이미 읽어 둔 요청은 바로 처리
+    if (keep && riox_park(&c->rio) == 0)
+	park_conn(fd);
+    else
+	Close(fd);
+}
+
+/*
+ * start_stats_thread - block SIGUSR1 in every thread (call before any
+ *     are created) and start one that prints cache counters on it
+ */
+void start_stats_thread(void)
+{
+    sigset_t mask;
+    pthread_t tid;
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    Pthread_create(&tid, NULL, stats_thread, NULL);
+}
+
+void *stats_thread(void *vargp)
+{
+    sigset_t mask;
+    int sig;
+
+    Pthread_detach(pthread_self());
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    while (1) {
+	if (sigwait(&mask, &sig) == 0) {                      // kill -USR1 <pid> 으로 캐시 통계 출력
+	    fcache_print_stats(stderr);
+	}
+    }
+    return NULL;
+}
+
+/*
+ * start_workers - create nthreads detached workers and their queue
+ */
+void start_workers(int nthreads)
+{
+    int i;
+    pthread_t tid;
+
+    sbuf_init(&sbuf, SBUFSIZE);
+    for (i = 0; i < nthreads; i++)
+	Pthread_create(&tid, NULL, worker, NULL);
+}
+
+/*
+ * worker - serve queued connections one after another, same as the
+ *     iterative loop
+ */
+void *worker(void *vargp)
+{
+    int connfd;
+    char buf[MAXBUF];
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	connfd = sbuf_remove(&sbuf);
+	if (conns) {                                          // -m epoll: 요청이 도착한 연결
+	    serve_ready(connfd, buf, sizeof(buf));
+	    continue;
+	}
+	serve_conn(connfd, -1);
+	Close(connfd);
+    }
+    return NULL;
+}
 /* $end tinymain */
 
 /*
- * doit - HTTP request/response를 다룬다.
+ * doit - HTTP request/response를 다룬다. 연결을 유지할 거면 1, 닫을 거면 0 반환
  */
 /* $begin doit */
-void doit(int fd) 
+int doit(int fd, riox_t *rp) 
 {
     int is_static;
     struct stat sbuf;
+    fentry_t *fe;
+    tiny_handler_fn *handler;
     char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
     char filename[MAXLINE], cgiargs[MAXLINE];
-    rio_t rio;
+    reqhdrs_t hdrs;
 
-    /* 헤더라인 읽기 */
-    Rio_readinitb(&rio, fd);
-    if (!Rio_readlineb(&rio, buf, MAXLINE))  //line:netp:doit:readrequest
-        return;
-    printf("%s", buf);
+    /* 헤더라인 읽기 (요청 사이의 빈 줄은 건너뜀) */
+    do {
+	if (riox_readlineb(rp, buf, MAXLINE) <= 0)  //line:netp:doit:readrequest
+	    return 0;                                 // 끊김 또는 idle timeout
+    } while (!strcmp(buf, "\r\n") || !strcmp(buf, "\n"));
+    if (verbose)
+	printf("%s", buf);
+    method[0] = uri[0] = version[0] = '\0';
     sscanf(buf, "%s %s %s", method, uri, version);
     if (strcasecmp(method, "GET")) {                     // Get 메소드 아니면 return
         clienterror(fd, method, "501", "Not Implemented",
                     "Tiny does not implement this method");
-        return;
+        return 0;
     }                                             
-    read_requesthdrs(&rio);                              // 헤더 읽기
+    read_requesthdrs(rp, &hdrs);                         // 헤더 읽기 (Range 등은 기억해 둠)
+    hdrs.http10 = strcasecmp(version, "HTTP/1.1") != 0;
+    hdrs.keepalive = idle_timeout > 0 && !hdrs.has_body &&   // 1.1은 기본 유지, 1.0은 keep-alive를 달라고 했을 때만
+	(hdrs.http10 ? hdrs.conn_keepalive : !hdrs.conn_close);
 
     /* Get 요청 파싱 */
     is_static = parse_uri(uri, filename, cgiargs);       // staic 인지 체크하기
-    if (stat(filename, &sbuf) < 0) {                     // 요청 없으면
-	clienterror(fd, filename, "404", "Not found",
-		    "Tiny couldn't find this file");
-	return;
-    }                                                    // 요청있을때
 
     if (is_static) { /* Serve static content */          
-	if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) { // 유효성 검사 -> 읽기 권한이 있는지 체크
-	    clienterror(fd, filename, "403", "Forbidden",
-			"Tiny couldn't read the file");
-	    return;
+	if (!(fe = fcache_get(filename))) {                  // 열린 파일 캐시에서 찾기 (없으면 열어서 넣음)
+	    if (errno == EACCES)                             // 유효성 검사 -> 일반 파일이고 읽기 권한이 있는지 체크
+		clienterror(fd, filename, "403", "Forbidden",
+			    "Tiny couldn't read the file");
+	    else                                             // 요청 없으면
+		clienterror(fd, filename, "404", "Not found",
+			    "Tiny couldn't find this file");
+	    return 0;
 	}
-	serve_static(fd, filename, sbuf.st_size);        // static 보내기
+	if (serve_static(fd, fe, &hdrs) < 0)             // static 보내기 (중간에 끊긴 응답 뒤로는 연결 유지 불가)
+	    hdrs.keepalive = 0;
+	fcache_put(fe);
+	return hdrs.keepalive;
     }
-    else { /* Serve dynamic content */
-	if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
-	    clienterror(fd, filename, "403", "Forbidden",
-			"Tiny couldn't run the CGI program");
-	    return;
-	}
-	serve_dynamic(fd, filename, cgiargs);            // 다이나믹 CGI 실행
+
+    if (use_plugins && (handler = plugin_find(uri))) {   // 해시 테이블에 등록된 플러그인이면 프로세스 안에서 처리
+	serve_plugin(fd, handler, method, uri, cgiargs, &hdrs);
+	return hdrs.keepalive;
+    }
+
+    if (stat(filename, &sbuf) < 0) {                     // 요청 없으면
+	clienterror(fd, filename, "404", "Not found",
+		    "Tiny couldn't find this file");
+	return 0;
+    }                                                    // 요청있을때
+    /* Serve dynamic content */
+    if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
+	clienterror(fd, filename, "403", "Forbidden",
+		    "Tiny couldn't run the CGI program");
+	return 0;
     }
+    serve_dynamic(fd, filename, cgiargs, &hdrs);         // 다이나믹 CGI 실행
+    return hdrs.keepalive;
 }
 /* $end doit */
 
@@ -96,20 +584,87 @@ void doit(int fd)
  * read_requesthdrs - read HTTP request headers
  */
 /* request 요청 읽기 */
-void read_requesthdrs(rio_t *rp) 
+void read_requesthdrs(riox_t *rp, reqhdrs_t *hdrs) 
 {
     char buf[MAXLINE];
 
-    Rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf);
-    while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
-	Rio_readlineb(rp, buf, MAXLINE);
+    hdrs->range[0] = '\0';
+    hdrs->encodings = 0;
+    hdrs->conn_close = hdrs->conn_keepalive = hdrs->has_body = 0;
+    if (riox_readlineb(rp, buf, MAXLINE) <= 0)
+	return;
+    if (verbose)
 	printf("%s", buf);
+    while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
+	if (!strncasecmp(buf, "Range:", 6))  // 이어받기/탐색용 Range 값 저장
+	    sscanf(buf + 6, " %[^\r\n]", hdrs->range);
+	if (!strncasecmp(buf, "Accept-Encoding:", 16)) // 받을 수 있는 압축 방식
+	    hdrs->encodings = parse_accept_encoding(buf + 16);
+	if (!strncasecmp(buf, "Connection:", 11)) {     // 연결 유지 여부 (close / keep-alive)
+	    hdrs->conn_close |= has_token(buf + 11, "close");
+	    hdrs->conn_keepalive |= has_token(buf + 11, "keep-alive");
+	}
+	if ((!strncasecmp(buf, "Content-Length:", 15) && atol(buf + 15) > 0) ||
+	    !strncasecmp(buf, "Transfer-Encoding:", 18))
+	    hdrs->has_body = 1;              // 본문은 읽지 않으니 이 연결은 여기까지
+	if (riox_readlineb(rp, buf, MAXLINE) <= 0) {   // 클라이언트가 끊으면 그만 읽기
+	    hdrs->conn_close = 1;
+	    return;
+	}
+	if (verbose)
+	    printf("%s", buf);
     }
     return;
 }
 /* $end read_requesthdrs */
 
+/*
+ * has_token - does a comma-separated header value contain token?
+ */
+int has_token(char *value, char *token)
+{
+    char copy[MAXLINE], *tok, *save;
+
+    strncpy(copy, value, MAXLINE - 1);
+    copy[MAXLINE - 1] = '\0';
+    for (tok = strtok_r(copy, ", \t\r\n", &save); tok;
+	 tok = strtok_r(NULL, ", \t\r\n", &save))
+	if (!strcasecmp(tok, token))
+	    return 1;
+    return 0;
+}
+
+/*
+ * parse_accept_encoding - turn an Accept-Encoding value ("gzip, deflate",
+ *     "gzip;q=0, *") into a mask of the codings tiny can send
+ */
+int parse_accept_encoding(char *value)
+{
+    char *tok, *q, *save;
+    double qvalue;
+    int mask = 0, bits;
+
+    for (tok = strtok_r(value, ",\r\n", &save); tok;
+	 tok = strtok_r(NULL, ",\r\n", &save)) {
+	tok += strspn(tok, " \t");
+	if (!strncasecmp(tok, "gzip", 4) && strchr(" \t;", tok[4]))
+	    bits = 1 << ENC_GZIP;
+	else if (!strncasecmp(tok, "x-gzip", 6) && strchr(" \t;", tok[6]))
+	    bits = 1 << ENC_GZIP;
+	else if (!strncasecmp(tok, "deflate", 7) && strchr(" \t;", tok[7]))
+	    bits = 1 << ENC_DEFLATE;
+	else if (tok[0] == '*' && strchr(" \t;", tok[1]))
+	    bits = (1 << ENC_GZIP) | (1 << ENC_DEFLATE);
+	else
+	    continue;
+	if ((q = strchr(tok, ';')) && sscanf(q, "; q=%lf", &qvalue) == 1 &&
+	    qvalue <= 0)                   // q=0 은 "보내지 마"
+	    continue;
+	mask |= bits;
+    }
+    return mask;
+}
+
 /*
  * parse_uri - parse URI into filename and CGI args
  *             return 0 if dynamic content, 1 if static
@@ -118,9 +673,9 @@ void read_requesthdrs(rio_t *rp)
 int parse_uri(char *uri, char *filename, char *cgiargs) 
 {
     char *ptr;
-    // 기본 가정 = 스트링 cgi-bin을 포함하는 모든 URI는 동적 컨텐츠를 요청한다고 생각
+    // 기본 가정 = /cgi-bin/ 으로 시작하는 모든 URI는 동적 컨텐츠를 요청한다고 생각
 
-    if (!strstr(uri, "cgi-bin")) {  // 스태틱 컨텐츠 일때
+    if (strncmp(uri, "/cgi-bin/", 9)) {  // 스태틱 컨텐츠 일때
 	strcpy(cgiargs, ""); // cgi 초기화
 	strcpy(filename, ".");  
 	strcat(filename, uri); // endconvert 변환
@@ -137,39 +692,250 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 	else 
 	    strcpy(cgiargs, ""); // 끝 부분 초기화
 	strcpy(filename, "."); // 처음꺼
-	strcat(filename, uri); // 두번째 convert
+	strcat(filename, uri); // 두번째 convert (uri 에는 이제 경로만 남음)
 	return 0;
     }
 }
 /* $end parse_uri */
 
 /*
- * serve_static - copy a file back to the client 
+ * serve_static - copy a file back to the client; returns -1 if the
+ *     response was cut off (the connection can't be reused)
  */
 /* $begin serve_static */
-void serve_static(int fd, char *filename, int filesize) 
+int serve_static(int fd, fentry_t *fe, reqhdrs_t *hdrs) 
 {
-    int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    char *srcp, buf[MAXLINE], *tail = end_headers(hdrs);
+    size_t filesize = fe->st.st_size;
+    struct iovec iov[3];
+    off_t offset = 0;
+    struct phttp_range ranges[MAXRANGES];
+    slice range = { hdrs->range, strlen(hdrs->range) };
+    int n, corked = 0, rc = 0;
+
+    /* Range 요청: 요청한 부분만 206으로 (문법이 틀린 Range는 무시하고 전체 전송) */
+    if (hdrs->range[0] &&
+	(n = phttp_parse_range(range, filesize, ranges, MAXRANGES)) >= 0) {
+	if (n > 0)
+	    return serve_ranges(fd, fe, ranges, n, tail);
+	sprintf(buf, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+	             "Server: Tiny Web Server\r\n"
+	             "Content-range: bytes */%lld\r\n"
+	             "Content-length: 0\r\n%s", (long long)filesize, tail);
+	return rio_writen(fd, buf, strlen(buf)) < 0 ? -1 : 0;
+    }
+
+    /* 클라이언트가 받아주면 압축된 응답 (.gz 파일 또는 zlib로 한 번 압축해서 캐시한 것) */
+    if (!hdrs->range[0] && hdrs->encodings &&
+	(rc = serve_encoded(fd, fe, hdrs->encodings, tail)) != 0)
+	return rc < 0 ? -1 : 0;
  
-    /* response 보내기  */
-    get_filetype(filename, filetype);       // 접미어 검사 해서 파일 타입 확인
-    // 응답 줄과 응답 헤더를 보내야함
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");    // 초기 버퍼 출력
-    sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-    sprintf(buf, "%sConnection: close\r\n", buf);
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
-    sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
-    Rio_writen(fd, buf, strlen(buf));       // 버퍼 안에 값 적용해버리기
-    printf("Response headers:\n");
-    printf("%s", buf);
-
-    /* Send response body to client */
-    srcfd = Open(filename, O_RDONLY, 0);    // 파일 디스크립터 번호 받기 및 Open()
-    srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);// malloc과 같은 함수
-    Close(srcfd);                           // 메모리로 매핑 한후 더 이상 식별자가 필요없으니 파일 닫는다.
-    Rio_writen(fd, srcp, filesize);         // 파일을 클라리언트에게 전송하기
-    Munmap(srcp, filesize);                 // free 느낌의 함수
+    /* response 보내기: 응답 줄과 헤더는 캐시 항목에 미리 만들어져 있음.
+       마지막 빈 줄 자리에 이 연결의 Connection 헤더 + 빈 줄 (tail) 을 끼워 넣음 */
+    if (verbose) {
+	printf("Response headers:\n");
+	printf("%.*s%s", (int)fe->hdrlen - 2, fe->hdr, tail);
+    }
+
+    /* Small file: the whole response is already in memory */
+    if (fe->resp) {
+	iov[0].iov_base = fe->resp;
+	iov[0].iov_len = fe->hdrlen - 2;
+	iov[1].iov_base = tail;
+	iov[1].iov_len = strlen(tail);
+	iov[2].iov_base = fe->resp + fe->hdrlen;
+	iov[2].iov_len = fe->resplen - fe->hdrlen;
+	return rio_writev(fd, iov, 3) < 0 ? -1 : 0; // writev 한 번으로 끝
+    }
+
+    /* Send body with sendfile (kernel copies file pages straight to the socket) */
+    iov[0].iov_base = fe->hdr;
+    iov[0].iov_len = fe->hdrlen - 2;
+    iov[1].iov_base = tail;
+    iov[1].iov_len = strlen(tail);
+    if (use_sendfile) {                         // 전역 설정은 그 사이에 바뀔 수 있으니 cork 여부는 corked로
+	rio_cork(fd, corked = 1);               // 헤더와 본문 앞부분이 같은 세그먼트로 나가도록 cork
+	if (rio_writev(fd, iov, 2) < 0 ||
+	    (filesize && rio_sendfile(fd, fe->fd, &offset, filesize) < 0 &&
+	     !sendfile_unavailable(offset)))    // 진짜 전송 오류 (파일이 줄어든 EIO 포함)
+	    rc = -1;
+	iov[0].iov_len = iov[1].iov_len = 0;    // sendfile 불가: 헤더는 이미 보냈으니 본문만 mmap으로
+    }
+
+    /* Fallback: mmap the file and send headers and body with one writev */
+    if (rc == 0 && (!corked || offset < filesize)) {
+	srcp = filesize ? Mmap(0, filesize, PROT_READ, MAP_PRIVATE, fe->fd, 0) : NULL; // 캐시의 열린 fd를 그대로 매핑
+	iov[2].iov_base = srcp;
+	iov[2].iov_len = filesize;
+	if (rio_writev(fd, iov, 3) < 0)         // 헤더와 파일을 한 번의 writev로 클라이언트에게 전송하기
+	    rc = -1;
+	if (srcp)
+	    Munmap(srcp, filesize);             // free 느낌의 함수
+    }
+    if (corked)
+	rio_cork(fd, 0);                        // cork 해제 = 남은 데이터 flush (오류가 나도 풀어 둠)
+    return rc;
+}
+
+/*
+ * serve_ranges - send the satisfiable ranges of a file as a 206
+ *     response: one range as is, several as multipart/byteranges;
+ *     returns -1 if the response was cut off
+ */
+int serve_ranges(int fd, fentry_t *fe, struct phttp_range *ranges, int n, char *tail)
+{
+    char hdr[MAXLINE], parthdr[MAXRANGES][256], boundary[64];
+    long long size = fe->st.st_size, len = 0;
+    int i, rc = 0;
+
+    if (n == 1) {
+	len = ranges[0].last - ranges[0].first + 1;
+	sprintf(hdr, "HTTP/1.1 206 Partial Content\r\n"
+	             "Server: Tiny Web Server\r\n"
+	             "Content-length: %lld\r\n"
+	             "Content-range: bytes %lld-%lld/%lld\r\n"
+	             "Content-type: %s\r\n%s",
+		len, (long long)ranges[0].first, (long long)ranges[0].last,
+		size, fe->filetype, tail);
+    }
+    else {
+	/* 본문에 나올 일 없는 구분자: inode와 mtime으로 만듦 */
+	sprintf(boundary, "tiny%llx%llx", (unsigned long long)fe->st.st_ino,
+		(unsigned long long)fe->st.st_mtim.tv_nsec);
+	for (i = 0; i < n; i++) {
+	    sprintf(parthdr[i], "\r\n--%s\r\n"
+	                        "Content-type: %s\r\n"
+	                        "Content-range: bytes %lld-%lld/%lld\r\n\r\n",
+		    boundary, fe->filetype, (long long)ranges[i].first,
+		    (long long)ranges[i].last, size);
+	    len += strlen(parthdr[i]) + ranges[i].last - ranges[i].first + 1;
+	}
+	len += strlen(boundary) + 8;             /* "\r\n--" boundary "--\r\n" */
+	sprintf(hdr, "HTTP/1.1 206 Partial Content\r\n"
+	             "Server: Tiny Web Server\r\n"
+	             "Content-length: %lld\r\n"
+	             "Content-type: multipart/byteranges; boundary=%s\r\n%s",
+		len, boundary, tail);
+    }
+    if (verbose) {
+	printf("Response headers:\n");
+	printf("%s", hdr);
+    }
+
+    rio_cork(fd, 1);                             // 헤더와 조각들을 꽉 찬 세그먼트로 묶어서 전송
+    if (rio_writen(fd, hdr, strlen(hdr)) < 0)
+	rc = -1;
+    for (i = 0; i < n && rc == 0; i++)
+	if ((n > 1 && rio_writen(fd, parthdr[i], strlen(parthdr[i])) < 0) ||
+	    send_range(fd, fe, ranges[i].first,
+		       ranges[i].last - ranges[i].first + 1) < 0)
+	    rc = -1;
+    if (n > 1 && rc == 0) {
+	sprintf(hdr, "\r\n--%s--\r\n", boundary);
+	if (rio_writen(fd, hdr, strlen(hdr)) < 0)
+	    rc = -1;
+    }
+    rio_cork(fd, 0);                             // 중간에 실패해도 cork는 풀어 둠
+    return rc;
+}
+
+/*
+ * send_range - send len bytes of a cached file starting at first, from
+ *     memory, with sendfile, or through an mmap of just that window;
+ *     returns 0, or -1 if not all of them went out (including a file
+ *     that shrank under sendfile: EIO)
+ */
+int send_range(int fd, fentry_t *fe, off_t first, size_t len)
+{
+    char *srcp;
+    off_t offset = first, start;
+    size_t maplen;
+    ssize_t rc;
+
+    if (fe->resp)                                // 메모리에 있는 응답에서 바로
+	return rio_writen(fd, fe->resp + fe->hdrlen + first, len) < 0 ? -1 : 0;
+    if (use_sendfile) {
+	if (rio_sendfile(fd, fe->fd, &offset, len) >= 0)
+	    return 0;
+	if (!sendfile_unavailable(offset - first))
+	    return -1;
+    }
+    start = first & ~((off_t)sysconf(_SC_PAGESIZE) - 1); // mmap 오프셋은 페이지 경계여야 함
+    maplen = len + (first - start);
+    srcp = Mmap(0, maplen, PROT_READ, MAP_PRIVATE, fe->fd, start);
+    rc = rio_writen(fd, srcp + (first - start), len);
+    Munmap(srcp, maplen);
+    return rc < 0 ? -1 : 0;
+}
+
+/*
+ * serve_encoded - send fe's response in the first coding the client
+ *     accepts that fcache has (or can build); returns 1 if it was
+ *     sent, 0 if there is none, or -1 if sending it failed
+ */
+int serve_encoded(int fd, fentry_t *fe, int encodings, char *tail)
+{
+    char *resp, *end;
+    size_t len, hdrlen;
+    struct iovec iov[3];
+    int enc;
+
+    for (enc = 0; enc < NENCODINGS; enc++) {        // gzip 우선
+	if (!(encodings & (1 << enc)) ||
+	    !(resp = fcache_encoded(fe, enc, compressible(fe->filetype), &len)))
+	    continue;
+	if (!(end = strstr(resp, "\r\n\r\n")))  // 헤더는 텍스트라 본문 앞에서 찾음
+	    continue;
+	hdrlen = end - resp + 2;                    // 마지막 빈 줄은 빼고 (tail 이 대신함)
+	if (verbose) {
+	    printf("Response headers:\n");
+	    printf("%.*s%s", (int)hdrlen, resp, tail);
+	}
+	iov[0].iov_base = resp;
+	iov[0].iov_len = hdrlen;
+	iov[1].iov_base = tail;
+	iov[1].iov_len = strlen(tail);
+	iov[2].iov_base = resp + hdrlen + 2;
+	iov[2].iov_len = len - hdrlen - 2;
+	return rio_writev(fd, iov, 3) < 0 ? -1 : 1; // 헤더 + 압축된 본문을 writev 한 번에
+    }
+    return 0;
+}
+
+/*
+ * end_headers - how a response's headers end on this connection: a
+ *     Connection header if needed, then the blank line
+ */
+char *end_headers(reqhdrs_t *hdrs)
+{
+    if (!hdrs->keepalive)
+	return "Connection: close\r\n\r\n";
+    if (hdrs->http10)                            // 1.0 클라이언트에게는 유지한다고 알려 줘야 함
+	return "Connection: keep-alive\r\n\r\n";
+    return "\r\n";                               // 1.1 은 기본이 keep-alive
+}
+
+/*
+ * compressible - is this a type worth compressing on the fly (text)?
+ */
+int compressible(char *filetype)
+{
+    return !strncmp(filetype, "text/", 5);
+}
+
+/*
+ * sendfile_unavailable - after rio_sendfile fails, decide whether
+ *     sendfile itself is unsupported here (nothing was sent and errno
+ *     says so); if it is, turn it off for good and return 1
+ */
+int sendfile_unavailable(off_t sent)
+{
+    if (sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+	fprintf(stderr, "sendfile unavailable (%s), using mmap\n", strerror(errno));
+	use_sendfile = 0;
+	return 1;
+    }
+    return 0;
 }
 
 /*
@@ -185,35 +951,209 @@ void get_filetype(char *filename, char *filetype)
 	strcpy(filetype, "image/png");
     else if (strstr(filename, ".jpg"))
 	strcpy(filetype, "image/jpeg");
+    else if (strstr(filename, ".mp4"))
+	strcpy(filetype, "video/mp4");
     else
 	strcpy(filetype, "text/plain");
 }  
+
+/*
+ * static_header - build the response header block for a cached file
+ *     whose body is len bytes in the given content coding (NULL for
+ *     the file as is); called once per file and coding by fcache. It
+ *     has no Connection header: serve_static puts that in place of the
+ *     final blank line for each connection (end_headers).
+ */
+void static_header(fentry_t *fe, char *encoding, size_t len, char *buf)
+{
+    sprintf(buf, "HTTP/1.1 200 OK\r\n"
+                 "Server: Tiny Web Server\r\n");
+    if (encoding)
+	sprintf(buf + strlen(buf), "Content-encoding: %s\r\n", encoding);
+    else
+	strcat(buf, "Accept-ranges: bytes\r\n");   // 범위 요청은 압축 안 한 파일 기준
+    if (encoding || compressible(fe->filetype))
+	strcat(buf, "Vary: Accept-Encoding\r\n");   // 캐시들이 압축본과 원본을 구분하도록
+    sprintf(buf + strlen(buf), "Content-length: %zu\r\n"
+                               "Content-type: %s\r\n\r\n",
+            len, fe->filetype);
+}
 /* $end serve_static */
 
 /*
  * 클라이언트에 동적 CGI 보여주기
  */
 /* $begin serve_dynamic */
-void serve_dynamic(int fd, char *filename, char *cgiargs) 
+void serve_dynamic(int fd, char *filename, char *cgiargs, reqhdrs_t *hdrs) 
 {
-    char buf[MAXLINE], *emptylist[] = { NULL };
+    char buf[MAXLINE], *out;
+    struct iovec iov;
+    size_t len;
+    int rc = CGIPOOL_FORK;
 
-    /* HTTP reponse 첫 부분 반환 */
-    sprintf(buf, "HTTP/1.0 200 OK\r\n"); 
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Server: Tiny Web Server\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-  
-    if (Fork() == 0) { /* 책 12장에 간단한 설명이 있음 -> child 생성 */
-	/* Real server would set all CGI vars here */
-	setenv("QUERY_STRING", cgiargs, 1); // 환경변수를 요청 URI의 CGI 인자들로 초기화 한다.
-	Dup2(fd, STDOUT_FILENO);         /* 자식은 자식의 표준 출력을 연결 파일 식별자로 재지정(복사) */
-	Execve(filename, emptylist, environ); /* 다시 CHI 프로그램을 로드하고 실행*/ //
+    /* 미리 띄워 둔 CGI 워커에게 맡기기: fork+exec 대신 소켓 왕복 한 번 */
+    if (use_cgipool)
+	rc = cgipool_run(filename, cgiargs, &out, &len);
+    /* 워커로 못 도는 일반 CGI 프로그램인데 연결을 유지할 거면: 길이를 알도록 출력을 파이프로 받음 */
+    if (rc == CGIPOOL_FORK && hdrs->keepalive)
+	rc = cgispawn_capture(filename, cgiargs, &out, &len);
+    if (rc == 0) {
+	rc = send_cgi_output(fd, out, len, hdrs);
+	Free(out);
     }
-    Wait(NULL); /* 부모는 자식이 종료되어 정리하는 것을 기다리기 */ 
+    if (rc < 0) {
+	hdrs->keepalive = 0;
+	clienterror(fd, filename, "502", "Bad Gateway",
+		    "Tiny's CGI program failed");
+    }
+    if (rc != CGIPOOL_FORK)
+	return;
+
+    /* 어차피 닫을 연결: 책처럼 CGI 출력이 곧바로 클라이언트로 (본문 끝 = 연결 끊김) */
+    /* HTTP reponse 첫 부분 반환 - MSG_MORE로 CGI 출력과 같은 세그먼트에 묶이게 */
+    sprintf(buf, "HTTP/1.1 200 OK\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: close\r\n");
+    iov.iov_base = buf;
+    iov.iov_len = strlen(buf);
+    if (rio_sendv(fd, &iov, 1, MSG_MORE) < 0)
+	return;
+
+    /* fork 대신 posix_spawn: 표준 출력을 연결 소켓으로 돌려서 실행하고 기다리지 않음.
+       연결은 이제 CGI 프로그램 것 - 끝나면 리퍼 스레드가 정리한다 */
+    if (cgispawn(fd, filename, cgiargs) < 0)
+	fprintf(stderr, "tiny: can't run %s: %s\n", filename, strerror(errno));
+}
+
+/*
+ * send_cgi_output - send a CGI program's output (header lines, a blank
+ *     line, the body) as a complete response: the program's Status
+ *     line if it gave one, its headers except Content-length and
+ *     Connection, and a Content-length for the body. Returns 0, or -1
+ *     if the output has no header block or too long a one (nothing
+ *     sent), or if sending failed.
+ */
+int send_cgi_output(int fd, char *out, size_t len, reqhdrs_t *hdrs)
+{
+    char hdr[MAXBUF], resp[2 * MAXBUF], status[MAXLINE] = "200 OK";
+    char *p = out, *end = out + len, *nl, *body = NULL;
+    size_t n, hlen = 0;
+    struct iovec iov[2];
+    int rlen;
+
+    while ((nl = memchr(p, '\n', end - p))) {
+	n = nl - p;
+	if (n > 0 && p[n - 1] == '\r')
+	    n--;
+	if (n == 0) {                            // 빈 줄: 여기부터 본문
+	    body = nl + 1;
+	    break;
+	}
+	if (n >= MAXLINE || hlen + n + 2 >= sizeof(hdr))
+	    return -1;
+	if (!strncasecmp(p, "Status:", 7)) {     // CGI 의 Status 헤더 -> 응답 줄
+	    for (p += 7, n -= 7; n > 0 && (*p == ' ' || *p == '\t'); p++, n--)
+		;
+	    snprintf(status, sizeof(status), "%.*s", (int)n, p);
+	}
+	else if (strncasecmp(p, "Content-length:", 15) &&
+		 strncasecmp(p, "Connection:", 11)) {  // 길이와 연결은 tiny가 정함
+	    memcpy(hdr + hlen, p, n);
+	    memcpy(hdr + hlen + n, "\r\n", 2);
+	    hlen += n + 2;
+	}
+	p = nl + 1;
+    }
+    if (!body)
+	return -1;
+    hdr[hlen] = '\0';
+
+    /* 응답 줄 + 프로그램의 헤더 + Content-length + 연결 헤더, 그리고 본문 */
+    rlen = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\n"
+                                        "Server: Tiny Web Server\r\n"
+                                        "%sContent-length: %zu\r\n%s",
+		    status, hdr, (size_t)(end - body), end_headers(hdrs));
+    if (rlen < 0 || rlen >= (int)sizeof(resp))   // 긴 Status 줄 + 긴 헤더: 잘린 헤더는 보내지 않음
+	return -1;
+    iov[0].iov_base = resp;
+    iov[0].iov_len = rlen;
+    iov[1].iov_base = body;
+    iov[1].iov_len = end - body;
+    return rio_writev(fd, iov, 2) < 0 ? -1 : 0;  // 실패하면 호출자가 연결을 닫음
 }
 /* $end serve_dynamic */
 
+/*
+ * serve_plugin - run an in-process handler and send its response: no
+ *     fork, no socket, just a function call into the loaded .so
+ */
+void serve_plugin(int fd, tiny_handler_fn *handler, char *method,
+		  char *path, char *cgiargs, reqhdrs_t *hdrs)
+{
+    char hdr[MAXLINE], body[MAXBUF];
+    tiny_req_t req = { method, path, cgiargs };
+    tiny_resp_t resp;
+    struct iovec iov[2];
+    int rc;
+
+    resp.status = 200;
+    strcpy(resp.content_type, "text/html");
+    resp.body = body;
+    resp.size = sizeof(body);
+    resp.len = 0;
+    rc = handler(&req, &resp);
+    if (rc == 0 && resp.len > resp.size) {       // 버퍼가 작았으면 필요한 만큼 잡아서 한 번 더
+	resp.size = resp.len;
+	resp.body = Malloc(resp.size);
+	resp.len = 0;
+	rc = handler(&req, &resp);
+    }
+    if (rc < 0 || resp.len > resp.size) {
+	hdrs->keepalive = 0;
+	clienterror(fd, path, "500", "Internal Server Error",
+		    "Tiny's handler failed");
+	goto done;
+    }
+    resp.content_type[sizeof(resp.content_type) - 1] = '\0';
+
+    sprintf(hdr, "HTTP/1.1 %d %s\r\n"
+	         "Server: Tiny Web Server\r\n"
+	         "Content-length: %zu\r\n"
+	         "Content-type: %s\r\n%s",
+	    resp.status, reason_phrase(resp.status), resp.len, resp.content_type,
+	    end_headers(hdrs));
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = strlen(hdr);
+    iov[1].iov_base = resp.body;
+    iov[1].iov_len = resp.len;
+    if (rio_writev(fd, iov, 2) < 0)              // 헤더와 본문을 한 번에
+	hdrs->keepalive = 0;
+ done:
+    if (resp.body != body)
+	Free(resp.body);
+}
+
+/*
+ * reason_phrase - status line text for a handler's status code
+ */
+char *reason_phrase(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return status < 400 ? "OK" : "Error";
+    }
+}
+
 /*
  * clienterror - returns an error message to the client
  */
@@ -222,6 +1162,7 @@ void clienterror(int fd, char *cause, char *errnum,
 		 char *shortmsg, char *longmsg) 
 {
     char buf[MAXLINE], body[MAXBUF];
+    struct iovec iov[2];
 
     /* Build the HTTP response body */
     sprintf(body, "<html><title>Tiny Error</title>");
@@ -230,13 +1171,15 @@ void clienterror(int fd, char *cause, char *errnum,
     sprintf(body, "%s<p>%s: %s\r\n", body, longmsg, cause);
     sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
 
-    /* Print the HTTP response */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-    Rio_writen(fd, buf, strlen(buf));
-    Rio_writen(fd, body, strlen(body));
+    /* Print the HTTP response (headers and body in one writev) */
+    sprintf(buf, "HTTP/1.1 %s %s\r\n"
+                 "Connection: close\r\n"
+                 "Content-type: text/html\r\n"
+                 "Content-length: %d\r\n\r\n", errnum, shortmsg, (int)strlen(body));
+    iov[0].iov_base = buf;
+    iov[0].iov_len = strlen(buf);
+    iov[1].iov_base = body;
+    iov[1].iov_len = strlen(body);
+    rio_writev(fd, iov, 2);
 }
 /* $end clienterror */
\ No newline at end of file